@@ -0,0 +1,358 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "analyze.h"
+#include "types.h"
+
+/* ---------- Image quality and detectability metrics ---------- */
+
+/* Pixel bytes compared per block */
+#define ANALYZE_BLOCK 65536
+
+/* Longest path built while walking directories */
+#define ANALYZE_PATH 4096
+
+/*
+ * Function: is_directory
+ * ----------------------
+ * Returns 1 if the path names a directory.
+ */
+static int is_directory(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+/*
+ * Function: read_and_validate_analyze_args
+ * ----------------------------------------
+ * Validates the arguments: either a cover and a stego image of the same
+ * format, or a cover directory and a stego directory.
+ */
+Status read_and_validate_analyze_args(char *argv[], AnalyzeInfo *anaInfo)
+{
+    if (argv[2] == NULL || argv[3] == NULL)
+    {
+        fprintf(stderr, "ERROR: Cover and stego image (or directories) are required.\n");
+        return e_failure;
+    }
+    anaInfo->cover_fname = argv[2];
+    anaInfo->stego_fname = argv[3];
+
+    if (is_directory(argv[2]) && is_directory(argv[3]))
+        return e_success;
+
+    if (pixel_source_ops_for(argv[2]) == NULL || pixel_source_ops_for(argv[2]) != pixel_source_ops_for(argv[3]))
+    {
+        fprintf(stderr, "ERROR: Cover and stego must both be '.bmp', '.y4m' or '.ppm' (or both directories)\n");
+        return e_failure;
+    }
+    return e_success;
+}
+
+/*
+ * Function: gamma_q
+ * -----------------
+ * Regularized upper incomplete gamma function Q(a, x), by series for small
+ * x and by continued fraction otherwise.
+ */
+static double gamma_q(double a, double x)
+{
+    double gln = lgamma(a);
+
+    if (x <= 0)
+        return 1.0;
+
+    if (x < a + 1)
+    {
+        double ap = a, term = 1.0 / a, sum = term;
+        for (int n = 0; n < 1000 && fabs(term) > fabs(sum) * 1e-14; n++)
+        {
+            ap += 1;
+            term *= x / ap;
+            sum += term;
+        }
+        return 1.0 - sum * exp(-x + a * log(x) - gln);
+    }
+    else
+    {
+        double b = x + 1 - a, c = 1e300, d = 1 / b, h = d, an, del;
+        for (int i = 1; i < 1000; i++)
+        {
+            an = -i * (i - a);
+            b += 2;
+            d = an * d + b;
+            if (fabs(d) < 1e-300)
+                d = 1e-300;
+            c = b + an / c;
+            if (fabs(c) < 1e-300)
+                c = 1e-300;
+            d = 1 / d;
+            del = d * c;
+            h *= del;
+            if (fabs(del - 1) < 1e-14)
+                break;
+        }
+        return exp(-x + a * log(x) - gln) * h;
+    }
+}
+
+/*
+ * Function: chi_square_pairs
+ * --------------------------
+ * Chi-square attack on the value pairs (2k, 2k+1): LSB embedding pulls the
+ * two counts of each pair together. Returns the statistic and the
+ * probability of embedding (near 1 when the pairs are suspiciously even).
+ */
+void chi_square_pairs(const unsigned long long *hist, double *chi, double *p)
+{
+    double expected, diff;
+    int categories = 0;
+
+    *chi = 0;
+    for (int k = 0; k < 128; k++)
+    {
+        expected = (hist[2 * k] + hist[2 * k + 1]) / 2.0;
+        if (expected > 0)
+        {
+            diff = hist[2 * k] - expected;
+            *chi += diff * diff / expected;
+            categories++;
+        }
+    }
+
+    *p = categories > 1 ? gamma_q((categories - 1) / 2.0, *chi / 2.0) : 0.0;
+}
+
+/*
+ * Function: analyze_block
+ * -----------------------
+ * Accumulates squared error, changed LSBs and value histograms for n
+ * matching cover and stego bytes. changed[] is indexed by (phase + i) % 3,
+ * the interleaved channel of byte i. With SSE2 the error and LSB counts
+ * run 48 bytes at a time, where lane j always falls on channel (phase + j) % 3.
+ */
+void analyze_block(AnalyzeStats *stats, const unsigned char *cover, const unsigned char *stego,
+                   size_t n, uint phase, unsigned long long changed[3])
+{
+    unsigned long long sq = 0;
+    size_t i = 0;
+    int d;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    unsigned char lanes[48];
+    unsigned int sums[4];
+
+    while (n - i >= 48)
+    {
+        // Byte lane counters and 32-bit squared sums are flushed before they can overflow
+        size_t groups = (n - i) / 48 > 255 ? 255 : (n - i) / 48;
+        __m128i acc[3] = { zero, zero, zero };
+        __m128i sq32 = zero;
+
+        for (size_t g = 0; g < groups; g++, i += 48)
+        {
+            for (int v = 0; v < 3; v++)
+            {
+                __m128i c = _mm_loadu_si128((const __m128i *)(cover + i + 16 * v));
+                __m128i s = _mm_loadu_si128((const __m128i *)(stego + i + 16 * v));
+                __m128i dlo = _mm_sub_epi16(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(s, zero));
+                __m128i dhi = _mm_sub_epi16(_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(s, zero));
+
+                acc[v] = _mm_add_epi8(acc[v], _mm_and_si128(_mm_xor_si128(c, s), one));
+                sq32 = _mm_add_epi32(sq32, _mm_add_epi32(_mm_madd_epi16(dlo, dlo), _mm_madd_epi16(dhi, dhi)));
+            }
+        }
+
+        _mm_storeu_si128((__m128i *)sums, sq32);
+        sq += (unsigned long long)sums[0] + sums[1] + sums[2] + sums[3];
+        for (int v = 0; v < 3; v++)
+            _mm_storeu_si128((__m128i *)(lanes + 16 * v), acc[v]);
+        for (int j = 0; j < 48; j++)
+            changed[(phase + j) % 3] += lanes[j];
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        d = cover[i] - stego[i];
+        sq += d * d;
+        changed[(phase + i) % 3] += (cover[i] ^ stego[i]) & 1;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        stats->cover_hist[cover[i]]++;
+        stats->stego_hist[stego[i]]++;
+    }
+
+    stats->sq_error += sq;
+    stats->bytes += n;
+}
+
+/*
+ * Function: analyze_streams
+ * -------------------------
+ * Walks the cover and the stego image in lockstep, one block at a time.
+ * Blocks never cross a frame (or, for planar Y4M, a plane) boundary, so
+ * every byte in a block can be mapped to its channel.
+ */
+static Status analyze_streams(AnalyzeInfo *anaInfo)
+{
+    static unsigned char cover_blk[ANALYZE_BLOCK], stego_blk[ANALYZE_BLOCK];
+    AnalyzeStats *stats = &anaInfo->stats;
+    PixelSource *cover = &anaInfo->cover;
+    unsigned long long span, offset, plane_end, changed[3];
+    size_t n, got;
+    int plane = 0;
+
+    while ((span = pixel_source_span(cover)) > 0)
+    {
+        offset = cover->frame_size - span; // position inside the frame
+        n = span < ANALYZE_BLOCK ? span : ANALYZE_BLOCK;
+
+        if (cover->planar)
+        {
+            for (plane = 0, plane_end = cover->plane_size[0]; plane < 2 && offset >= plane_end; )
+                plane_end += cover->plane_size[++plane];
+            if (n > plane_end - offset)
+                n = plane_end - offset;
+        }
+
+        got = pixel_source_read_span(cover, (char *)cover_blk, n);
+        if (got == 0 || pixel_source_read(&anaInfo->stego, (char *)stego_blk, got) != got)
+        {
+            fprintf(stderr, "ERROR: %s and %s differ in size\n", anaInfo->cover_fname, anaInfo->stego_fname);
+            return e_failure;
+        }
+
+        changed[0] = changed[1] = changed[2] = 0;
+        analyze_block(stats, cover_blk, stego_blk, got, offset % 3, changed);
+
+        if (cover->planar)
+        {
+            stats->changed_lsb[plane] += changed[0] + changed[1] + changed[2];
+            stats->channel_bytes[plane] += got;
+        }
+        else
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                stats->changed_lsb[k] += changed[k];
+                stats->channel_bytes[k] += got / 3 + ((k - offset % 3 + 3) % 3 < got % 3);
+            }
+        }
+    }
+
+    if (pixel_source_span(&anaInfo->stego) != 0)
+    {
+        fprintf(stderr, "ERROR: %s and %s differ in size\n", anaInfo->cover_fname, anaInfo->stego_fname);
+        return e_failure;
+    }
+    return e_success;
+}
+
+/*
+ * Function: analyze_pair
+ * ----------------------
+ * Opens one cover/stego pair, gathers statistics in a single pass and
+ * prints one report line.
+ */
+Status analyze_pair(AnalyzeInfo *anaInfo)
+{
+    Status status = e_failure;
+    const char *channels;
+
+    memset(&anaInfo->stats, 0, sizeof(anaInfo->stats));
+    anaInfo->fptr_cover = fopen(anaInfo->cover_fname, "r");
+    anaInfo->fptr_stego = fopen(anaInfo->stego_fname, "r");
+    if (anaInfo->fptr_cover == NULL || anaInfo->fptr_stego == NULL)
+    {
+        perror("fopen");
+        fprintf(stderr, "ERROR: Unable to open %s or %s\n", anaInfo->cover_fname, anaInfo->stego_fname);
+    }
+    else if (pixel_source_open(&anaInfo->cover, anaInfo->cover_fname, anaInfo->fptr_cover, NULL) == e_success &&
+             pixel_source_open(&anaInfo->stego, anaInfo->stego_fname, anaInfo->fptr_stego, NULL) == e_success &&
+             pixel_source_begin(&anaInfo->cover) == e_success &&
+             pixel_source_begin(&anaInfo->stego) == e_success &&
+             analyze_streams(anaInfo) == e_success)
+    {
+        AnalyzeStats *stats = &anaInfo->stats;
+
+        anaInfo->mse = stats->bytes ? (double)stats->sq_error / stats->bytes : 0.0;
+        anaInfo->psnr = anaInfo->mse > 0 ? 10.0 * log10(255.0 * 255.0 / anaInfo->mse) : INFINITY;
+        chi_square_pairs(stats->cover_hist, &anaInfo->cover_chi, &anaInfo->cover_p);
+        chi_square_pairs(stats->stego_hist, &anaInfo->stego_chi, &anaInfo->stego_p);
+
+        channels = anaInfo->cover.ops->channels;
+        printf("%s vs %s: bytes=%llu mse=%.6f psnr=%.2f dB", anaInfo->cover_fname, anaInfo->stego_fname,
+               stats->bytes, anaInfo->mse, anaInfo->psnr);
+        for (int k = 0; k < ANALYZE_CHANNELS; k++)
+            printf(" lsb_%c=%llu/%llu", channels[k], stats->changed_lsb[k], stats->channel_bytes[k]);
+        printf(" chi2_cover=%.2f p=%.4f chi2_stego=%.2f p=%.4f\n",
+               anaInfo->cover_chi, anaInfo->cover_p, anaInfo->stego_chi, anaInfo->stego_p);
+        status = e_success;
+    }
+
+    if (anaInfo->fptr_cover != NULL)
+        fclose(anaInfo->fptr_cover);
+    if (anaInfo->fptr_stego != NULL)
+        fclose(anaInfo->fptr_stego);
+    return status;
+}
+
+/*
+ * Function: do_analysis
+ * ---------------------
+ * Analyzes a single pair, or in batch mode every supported image in the
+ * cover directory that has a stego image of the same name.
+ */
+Status do_analysis(AnalyzeInfo *anaInfo)
+{
+    char *cover_dir = anaInfo->cover_fname, *stego_dir = anaInfo->stego_fname;
+    char cover_path[ANALYZE_PATH], stego_path[ANALYZE_PATH];
+    struct dirent *entry;
+    int pairs = 0, failed = 0;
+    DIR *dir;
+
+    if (!is_directory(cover_dir))
+        return analyze_pair(anaInfo);
+
+    dir = opendir(cover_dir);
+    if (dir == NULL)
+    {
+        perror("opendir");
+        return e_failure;
+    }
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] == '.' || pixel_source_ops_for(entry->d_name) == NULL)
+            continue;
+
+        snprintf(cover_path, sizeof(cover_path), "%s/%s", cover_dir, entry->d_name);
+        snprintf(stego_path, sizeof(stego_path), "%s/%s", stego_dir, entry->d_name);
+        if (access(stego_path, R_OK) != 0)
+            continue;
+
+        anaInfo->cover_fname = cover_path;
+        anaInfo->stego_fname = stego_path;
+        pairs++;
+        if (analyze_pair(anaInfo) != e_success)
+            failed++;
+    }
+    closedir(dir);
+
+    anaInfo->cover_fname = cover_dir;
+    anaInfo->stego_fname = stego_dir;
+    printf("Analyzed %d pairs, %d failed\n", pairs, failed);
+    return (pairs > 0 && failed == 0) ? e_success : e_failure;
+}
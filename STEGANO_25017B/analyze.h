@@ -0,0 +1,64 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
+
+#include <stdio.h>
+#include "types.h"        // Contains user defined types
+#include "pixel_source.h" // Cover stream backends
+
+/* Channels reported per image (B,G,R / R,G,B / Y,U,V) */
+#define ANALYZE_CHANNELS 3
+
+/* Statistics gathered in one pass over a cover and its stego image */
+typedef struct _AnalyzeStats
+{
+    unsigned long long bytes;                            // Pixel bytes compared
+    unsigned long long sq_error;                         // Sum of squared byte differences
+    unsigned long long channel_bytes[ANALYZE_CHANNELS];  // Pixel bytes per channel
+    unsigned long long changed_lsb[ANALYZE_CHANNELS];    // Pixel bytes whose LSB differs, per channel
+    unsigned long long cover_hist[256];                  // Value histogram of the cover
+    unsigned long long stego_hist[256];                  // Value histogram of the stego image
+} AnalyzeStats;
+
+/*
+ * Structure to store information required for
+ * comparing a stego image against its cover
+ */
+typedef struct _AnalyzeInfo
+{
+    /* Input images */
+    char *cover_fname;       // To store the cover image name
+    FILE *fptr_cover;        // To store the address of the cover image
+    PixelSource cover;       // To read the cover pixels
+    char *stego_fname;       // To store the stego image name
+    FILE *fptr_stego;        // To store the address of the stego image
+    PixelSource stego;       // To read the stego pixels
+
+    /* Results */
+    AnalyzeStats stats;      // Raw counters
+    double mse;              // Mean squared error per pixel byte
+    double psnr;             // Peak signal-to-noise ratio in dB
+    double cover_chi;        // Chi-square of the cover LSB pairs
+    double cover_p;          // Probability of embedding for the cover
+    double stego_chi;        // Chi-square of the stego LSB pairs
+    double stego_p;          // Probability of embedding for the stego image
+} AnalyzeInfo;
+
+/* Analyze function prototypes */
+
+/* Read and validate Analyze args from argv */
+Status read_and_validate_analyze_args(char *argv[], AnalyzeInfo *anaInfo);
+
+/* Analyze one pair of images, or every pair in two directories */
+Status do_analysis(AnalyzeInfo *anaInfo);
+
+/* Analyze one cover/stego pair and print its report line */
+Status analyze_pair(AnalyzeInfo *anaInfo);
+
+/* Accumulate statistics for a block of matching cover and stego bytes */
+void analyze_block(AnalyzeStats *stats, const unsigned char *cover, const unsigned char *stego,
+                   size_t n, uint phase, unsigned long long changed[3]);
+
+/* Chi-square statistic of the LSB value pairs and the matching embedding probability */
+void chi_square_pairs(const unsigned long long *hist, double *chi, double *p);
+
+#endif
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "types.h"
+
+/* ---------- Per-worker arenas, buffer pools and the allocation counter ---------- */
+
+/* Alignment of arena allocations */
+#define ARENA_ALIGN 16
+
+/* Heap allocations of the process (all threads) */
+static unsigned long alloc_count;
+
+#if defined(__GLIBC__)
+/*
+ * glibc lets a program replace malloc. The replacements below count every
+ * allocation of the process, including the ones the C library makes for
+ * itself (FILE objects, stdio buffers, ...), and hand the call on to the
+ * glibc allocator.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+#define COUNT_ALLOC() // counted by malloc/calloc/realloc themselves
+
+void *malloc(size_t size)
+{
+    __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+#else
+// Elsewhere only the allocations of this program are seen
+#define COUNT_ALLOC() __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED)
+#endif
+
+/*
+ * Function: counted_malloc
+ * ------------------------
+ * malloc() that is always counted, so the steady state can be shown to be
+ * allocation free.
+ */
+void *counted_malloc(size_t size)
+{
+    COUNT_ALLOC();
+    return malloc(size);
+}
+
+/*
+ * Function: counted_realloc
+ * -------------------------
+ * realloc() that counts the call like counted_malloc.
+ */
+void *counted_realloc(void *ptr, size_t size)
+{
+    COUNT_ALLOC();
+    return realloc(ptr, size);
+}
+
+/*
+ * Function: counted_free
+ * ----------------------
+ * Releases memory from counted_malloc/counted_realloc.
+ */
+void counted_free(void *ptr)
+{
+    free(ptr);
+}
+
+/*
+ * Function: get_alloc_count
+ * -------------------------
+ * Returns the number of heap allocations counted so far.
+ */
+unsigned long get_alloc_count(void)
+{
+    return __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+}
+
+/*
+ * Function: arena_alloc
+ * ---------------------
+ * Hands out the next size bytes of the arena, aligned to ARENA_ALIGN.
+ * Returns NULL when the arena is full; nothing is freed until a reset.
+ */
+void *arena_alloc(Arena *arena, size_t size)
+{
+    size_t start = (arena->used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    if (start > arena->size || size > arena->size - start)
+        return NULL;
+    arena->used = start + size;
+    return arena->base + start;
+}
+
+/*
+ * Function: arena_join
+ * --------------------
+ * Copies first followed by second into the arena (e.g. a file name and its
+ * extension). Returns NULL when the arena is full.
+ */
+char *arena_join(Arena *arena, const char *first, const char *second)
+{
+    size_t first_len = strlen(first), second_len = strlen(second);
+    char *str = arena_alloc(arena, first_len + second_len + 1);
+
+    if (str == NULL)
+    {
+        fprintf(stderr, "ERROR: File name %s%s is too long\n", first, second);
+        return NULL;
+    }
+    memcpy(str, first, first_len);
+    memcpy(str + first_len, second, second_len + 1);
+    return str;
+}
+
+/*
+ * Function: workspace_init
+ * ------------------------
+ * Allocates one block for the arena, the stdio buffer pool and the payload
+ * buffer. This is the only heap allocation a worker makes for its jobs.
+ */
+Status workspace_init(Workspace *ws)
+{
+    char *p;
+
+    memset(ws, 0, sizeof(*ws));
+    ws->block = counted_malloc(ARENA_SIZE + IO_BUFFERS * IO_BUFFER_SIZE + PAYLOAD_BUFFER_SIZE);
+    if (ws->block == NULL)
+    {
+        fprintf(stderr, "ERROR: Unable to allocate the job workspace\n");
+        return e_failure;
+    }
+
+    p = ws->block;
+    for (int i = 0; i < IO_BUFFERS; i++, p += IO_BUFFER_SIZE)
+        ws->io_buf[i] = p;
+    ws->payload = p;
+    p += PAYLOAD_BUFFER_SIZE;
+    ws->arena.base = p;
+    ws->arena.size = ARENA_SIZE;
+    return e_success;
+}
+
+/*
+ * Function: workspace_begin_job
+ * -----------------------------
+ * Starts a job: the arena is emptied and the stdio buffers handed out again.
+ * The streams of the previous job must have been closed.
+ */
+void workspace_begin_job(Workspace *ws)
+{
+    ws->arena.used = 0;
+    ws->io_used = 0;
+}
+
+/*
+ * Function: workspace_buffer_stream
+ * ---------------------------------
+ * Gives a stream the next pooled buffer, so stdio does not allocate its own.
+ * Must be called right after fopen. With the pool used up the stream keeps
+ * the default stdio buffer.
+ */
+void workspace_buffer_stream(Workspace *ws, FILE *fptr)
+{
+    if (ws->io_used < IO_BUFFERS && setvbuf(fptr, ws->io_buf[ws->io_used], _IOFBF, IO_BUFFER_SIZE) == 0)
+        ws->io_used++;
+}
+
+/*
+ * Function: workspace_free
+ * ------------------------
+ * Releases the workspace block.
+ */
+void workspace_free(Workspace *ws)
+{
+    counted_free(ws->block);
+    ws->block = NULL;
+}
@@ -0,0 +1,68 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdio.h>
+#include "types.h" // Contains user defined types
+
+/* Per-job scratch space (file names and other small strings) */
+#define ARENA_SIZE (16 * 1024)
+
+/* stdio buffer given to each stream a job opens */
+#define IO_BUFFER_SIZE 65536
+
+/* Streams a job keeps open at once (cover, secret, stego) */
+#define IO_BUFFERS 3
+
+/* Secret bytes moved per chunk while encoding */
+#define PAYLOAD_BUFFER_SIZE 65536
+
+/* Bump allocator: everything is released at once by arena_reset */
+typedef struct _Arena
+{
+    char *base;     // Start of the arena memory
+    size_t size;    // Bytes available
+    size_t used;    // Bytes handed out since the last reset
+} Arena;
+
+/*
+ * Memory a worker reuses from job to job: one heap block, allocated once,
+ * carved into an arena, a pool of stdio buffers and the payload buffer.
+ */
+typedef struct _Workspace
+{
+    char *block;                 // The single heap block everything lives in
+    Arena arena;                 // Per-job scratch, reset when a job starts
+    char *io_buf[IO_BUFFERS];    // Pooled stdio buffers, handed out in order
+    int io_used;                 // io_buf[] handed out to the current job
+    char *payload;               // Secret chunk buffer (PAYLOAD_BUFFER_SIZE bytes)
+} Workspace;
+
+/* Arena function prototypes */
+
+/* Heap allocation through the allocation counter */
+void *counted_malloc(size_t size);
+void *counted_realloc(void *ptr, size_t size);
+void counted_free(void *ptr);
+
+/* Number of heap allocations counted so far (with glibc: every allocation of the process) */
+unsigned long get_alloc_count(void);
+
+/* Take size bytes from the arena, NULL when it is full */
+void *arena_alloc(Arena *arena, size_t size);
+
+/* Concatenate two strings into the arena, NULL when it is full */
+char *arena_join(Arena *arena, const char *first, const char *second);
+
+/* Allocate the workspace block (the only allocation of a worker) */
+Status workspace_init(Workspace *ws);
+
+/* Start a new job: reset the arena and take back the stdio buffers */
+void workspace_begin_job(Workspace *ws);
+
+/* Give a freshly opened stream a pooled buffer (before any I/O on it) */
+void workspace_buffer_stream(Workspace *ws, FILE *fptr);
+
+/* Release the workspace block */
+void workspace_free(Workspace *ws);
+
+#endif
@@ -0,0 +1,405 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#if defined(__linux__)
+#include <linux/fs.h>
+#endif
+#include "cache.h"
+#include "types.h"
+#include "arena.h"
+
+/* ---------- Content-addressed cache of encode results ---------- */
+
+/* Block size used for hashing and copying files */
+#define CACHE_BLOCK 65536
+
+/* Longest path built inside the cache directory */
+#define CACHE_PATH 4096
+
+/* XXH64 primes */
+#define PRIME64_1 11400714785074694791ULL
+#define PRIME64_2 14029467366897019727ULL
+#define PRIME64_3 1609587929392839161ULL
+#define PRIME64_4 9650029242287828579ULL
+#define PRIME64_5 2870177450012600261ULL
+
+static uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t read64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t hash_round(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static uint64_t hash_merge_round(uint64_t acc, uint64_t val)
+{
+    acc ^= hash_round(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+/*
+ * Function: hash_init
+ * -------------------
+ * Starts a streaming XXH64 hash. Four independent lanes of 8 bytes each
+ * keep the multiplier pipelines busy, so hashing runs near memory speed.
+ */
+void hash_init(HashState *state, uint64_t seed)
+{
+    memset(state, 0, sizeof(*state));
+    state->seed = seed;
+    state->v[0] = seed + PRIME64_1 + PRIME64_2;
+    state->v[1] = seed + PRIME64_2;
+    state->v[2] = seed;
+    state->v[3] = seed - PRIME64_1;
+}
+
+/*
+ * Function: hash_update
+ * ---------------------
+ * Feeds len bytes into the hash, one 32-byte stripe at a time.
+ */
+void hash_update(HashState *state, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    const unsigned char *end = p + len;
+
+    state->total_len += len;
+
+    // Not enough for a stripe yet: keep the bytes for later
+    if (state->memsize + len < 32)
+    {
+        memcpy(state->mem + state->memsize, p, len);
+        state->memsize += len;
+        return;
+    }
+
+    // Complete the stripe left over from the previous call
+    if (state->memsize > 0)
+    {
+        memcpy(state->mem + state->memsize, p, 32 - state->memsize);
+        p += 32 - state->memsize;
+        for (int i = 0; i < 4; i++)
+            state->v[i] = hash_round(state->v[i], read64(state->mem + 8 * i));
+        state->memsize = 0;
+    }
+
+    while (end - p >= 32)
+    {
+        for (int i = 0; i < 4; i++)
+            state->v[i] = hash_round(state->v[i], read64(p + 8 * i));
+        p += 32;
+    }
+
+    memcpy(state->mem, p, end - p);
+    state->memsize = end - p;
+}
+
+/*
+ * Function: hash_final
+ * --------------------
+ * Merges the lanes and the leftover bytes into the final 64-bit hash.
+ */
+uint64_t hash_final(const HashState *state)
+{
+    const unsigned char *p = state->mem;
+    const unsigned char *end = p + state->memsize;
+    uint64_t h;
+
+    if (state->total_len >= 32)
+    {
+        h = rotl64(state->v[0], 1) + rotl64(state->v[1], 7) + rotl64(state->v[2], 12) + rotl64(state->v[3], 18);
+        for (int i = 0; i < 4; i++)
+            h = hash_merge_round(h, state->v[i]);
+    }
+    else
+        h = state->seed + PRIME64_5;
+
+    h += state->total_len;
+
+    for (; end - p >= 8; p += 8)
+    {
+        h ^= hash_round(0, read64(p));
+        h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (end - p >= 4)
+    {
+        uint32_t k;
+        memcpy(&k, p, sizeof(k));
+        h ^= (uint64_t)k * PRIME64_1;
+        h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; p++)
+    {
+        h ^= *p * PRIME64_5;
+        h = rotl64(h, 11) * PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+/*
+ * Function: hash_file
+ * -------------------
+ * Hashes a whole file from its start and rewinds it again.
+ * Fails for streams that cannot be rewound (pipes), and once the job is
+ * cancelled (checked every block).
+ */
+Status hash_file(FILE *fptr, uint64_t seed, uint64_t *hash, const Progress *progress)
+{
+    unsigned char block[CACHE_BLOCK];
+    HashState state;
+    size_t got;
+
+    if (fseek(fptr, 0, SEEK_SET) != 0)
+        return e_failure;
+
+    hash_init(&state, seed);
+    while ((got = fread(block, 1, sizeof(block), fptr)) > 0)
+    {
+        if (progress_cancelled(progress))
+            return e_failure;
+        hash_update(&state, block, got);
+    }
+
+    if (ferror(fptr) || fseek(fptr, 0, SEEK_SET) != 0)
+        return e_failure;
+
+    *hash = hash_final(&state);
+    return e_success;
+}
+
+/*
+ * Function: cache_make_key
+ * ------------------------
+ * Builds the 32 hex character key of a (cover, payload, options) triple.
+ */
+void cache_make_key(char *key, uint64_t cover_hash, uint64_t payload_hash, const char *options)
+{
+    HashState state;
+
+    hash_init(&state, payload_hash);
+    hash_update(&state, options, strlen(options));
+    snprintf(key, CACHE_KEY_LEN + 1, "%016llx%016llx",
+             (unsigned long long)cover_hash, (unsigned long long)hash_final(&state));
+}
+
+/*
+ * Function: copy_file_data
+ * ------------------------
+ * Makes fptr_out a copy of fptr_in: a reflink (shared extents, copy on
+ * write) where the filesystem supports it, a plain block copy otherwise.
+ */
+static Status copy_file_data(FILE *fptr_in, FILE *fptr_out)
+{
+    char block[CACHE_BLOCK];
+    size_t got;
+
+    if (fflush(fptr_out) != 0)
+        return e_failure;
+
+#if defined(FICLONE)
+    if (ioctl(fileno(fptr_out), FICLONE, fileno(fptr_in)) == 0)
+        return e_success;
+#endif
+
+    while ((got = fread(block, 1, sizeof(block), fptr_in)) > 0)
+    {
+        if (fwrite(block, 1, got, fptr_out) != got)
+            return e_failure;
+    }
+    return (ferror(fptr_in) || fflush(fptr_out) != 0) ? e_failure : e_success;
+}
+
+/*
+ * Function: cache_fetch
+ * ---------------------
+ * Looks up key in the cache. On a hit the entry is copied (or reflinked)
+ * into a new file fname, flushed to disk, and marked as recently used. A
+ * copy that fails partway is removed, so fname exists only if complete.
+ */
+Status cache_fetch(const char *dir, const char *key, const char *extn, const char *fname)
+{
+    char path[CACHE_PATH];
+    FILE *fptr_entry, *fptr_out;
+    Status status = e_failure;
+
+    snprintf(path, sizeof(path), "%s/%s%s", dir, key, extn);
+    fptr_entry = fopen(path, "r");
+    if (fptr_entry == NULL)
+        return e_failure; // miss
+
+    fptr_out = fopen(fname, "w");
+    if (fptr_out != NULL)
+    {
+        status = copy_file_data(fptr_entry, fptr_out);
+        if (status == e_success && fsync(fileno(fptr_out)) != 0)
+            status = e_failure;
+        if (fclose(fptr_out) != 0)
+            status = e_failure;
+    }
+    fclose(fptr_entry);
+
+    if (status != e_success)
+    {
+        fprintf(stderr, "WARNING: Unable to copy cache entry %s, encoding instead\n", path);
+        unlink(fname);
+        return e_failure;
+    }
+
+    // The modification time orders entries for LRU eviction
+    utimensat(AT_FDCWD, path, NULL, 0);
+    return e_success;
+}
+
+/*
+ * Function: cache_store
+ * ---------------------
+ * Copies a finished output into the cache under a temporary name and
+ * renames it into place, so concurrent jobs never see a partial entry.
+ */
+Status cache_store(const char *dir, const char *key, const char *extn, const char *fname,
+                   unsigned long long max_bytes)
+{
+    char path[CACHE_PATH], tmp_path[CACHE_PATH];
+    FILE *fptr_in, *fptr_tmp;
+    Status status = e_failure;
+
+    mkdir(dir, 0777); // may already exist
+
+    snprintf(path, sizeof(path), "%s/%s%s", dir, key, extn);
+    snprintf(tmp_path, sizeof(tmp_path), "%s/%s%s.tmp.%ld", dir, key, extn, (long)getpid());
+
+    fptr_in = fopen(fname, "r");
+    fptr_tmp = fopen(tmp_path, "w");
+    if (fptr_in != NULL && fptr_tmp != NULL)
+        status = copy_file_data(fptr_in, fptr_tmp);
+
+    if (fptr_in != NULL)
+        fclose(fptr_in);
+    if (fptr_tmp != NULL && fclose(fptr_tmp) != 0)
+        status = e_failure;
+
+    if (status == e_success && rename(tmp_path, path) != 0)
+        status = e_failure;
+    if (status != e_success)
+    {
+        fprintf(stderr, "WARNING: Unable to store %s in cache %s\n", fname, dir);
+        unlink(tmp_path);
+        return e_failure;
+    }
+
+    return cache_evict(dir, max_bytes);
+}
+
+/* One cache entry seen while evicting */
+typedef struct _CacheEntry
+{
+    struct timespec mtime;     // Last use
+    unsigned long long size;   // Bytes on disk
+    char name[CACHE_KEY_LEN + 8];
+} CacheEntry;
+
+static int compare_entries(const void *a, const void *b)
+{
+    const CacheEntry *x = a, *y = b;
+
+    if (x->mtime.tv_sec != y->mtime.tv_sec)
+        return x->mtime.tv_sec < y->mtime.tv_sec ? -1 : 1;
+    if (x->mtime.tv_nsec != y->mtime.tv_nsec)
+        return x->mtime.tv_nsec < y->mtime.tv_nsec ? -1 : 1;
+    return 0;
+}
+
+/*
+ * Function: is_cache_entry
+ * ------------------------
+ * Cache entries are named <32 hex digits><extension>, temporaries excluded.
+ */
+static int is_cache_entry(const char *name)
+{
+    for (int i = 0; i < CACHE_KEY_LEN; i++)
+    {
+        if (!isxdigit((unsigned char)name[i]))
+            return 0;
+    }
+    return strstr(name, ".tmp.") == NULL && strlen(name) < CACHE_KEY_LEN + 8;
+}
+
+/*
+ * Function: cache_evict
+ * ---------------------
+ * Removes least recently used entries until the cache fits in max_bytes.
+ */
+Status cache_evict(const char *dir, unsigned long long max_bytes)
+{
+    char path[CACHE_PATH];
+    CacheEntry *entries = NULL, *grown;
+    size_t count = 0, cap = 0;
+    unsigned long long total = 0;
+    struct dirent *dent;
+    struct stat st;
+    DIR *dirp;
+
+    dirp = opendir(dir);
+    if (dirp == NULL)
+        return e_failure;
+
+    while ((dent = readdir(dirp)) != NULL)
+    {
+        if (!is_cache_entry(dent->d_name))
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, dent->d_name);
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        if (count == cap)
+        {
+            cap = cap ? cap * 2 : 64;
+            grown = counted_realloc(entries, cap * sizeof(*entries));
+            if (grown == NULL)
+                break;
+            entries = grown;
+        }
+        entries[count].mtime = st.st_mtim;
+        entries[count].size = st.st_size;
+        strcpy(entries[count].name, dent->d_name);
+        total += st.st_size;
+        count++;
+    }
+    closedir(dirp);
+
+    if (count > 0)
+        qsort(entries, count, sizeof(*entries), compare_entries);
+    for (size_t i = 0; i < count && total > max_bytes; i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", dir, entries[i].name);
+        if (unlink(path) == 0)
+            total -= entries[i].size;
+    }
+
+    counted_free(entries);
+    return e_success;
+}
@@ -0,0 +1,48 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "types.h" // Contains user defined types
+#include "progress.h" // Cancellation of long hash passes
+
+/* Cache key: two 64-bit hashes in hex */
+#define CACHE_KEY_LEN 32
+
+/* Default size bound of the cache directory */
+#define CACHE_DEFAULT_MAX (1024ULL * 1024 * 1024)
+
+/* Streaming state of the 64-bit content hash (XXH64) */
+typedef struct _HashState
+{
+    uint64_t v[4];            // Lane accumulators
+    uint64_t seed;            // Seed the hash was started with
+    uint64_t total_len;       // Bytes hashed so far
+    unsigned char mem[32];    // Bytes not yet forming a full 32-byte stripe
+    uint memsize;             // Number of bytes in mem[]
+} HashState;
+
+/* Cache function prototypes */
+
+/* Start, feed and finish a content hash */
+void hash_init(HashState *state, uint64_t seed);
+void hash_update(HashState *state, const void *data, size_t len);
+uint64_t hash_final(const HashState *state);
+
+/* Hash a whole seekable file from its start, leaving it rewound; stops if progress is cancelled */
+Status hash_file(FILE *fptr, uint64_t seed, uint64_t *hash, const Progress *progress);
+
+/* Build the cache key of a (cover, payload, options) triple */
+void cache_make_key(char *key, uint64_t cover_hash, uint64_t payload_hash, const char *options);
+
+/* Copy a cached result to a new file fname, e_failure (and no file) on a miss or error */
+Status cache_fetch(const char *dir, const char *key, const char *extn, const char *fname);
+
+/* Store a finished output under key, then evict least recently used entries above max_bytes */
+Status cache_store(const char *dir, const char *key, const char *extn, const char *fname,
+                   unsigned long long max_bytes);
+
+/* Remove least recently used entries until the cache holds at most max_bytes */
+Status cache_evict(const char *dir, unsigned long long max_bytes);
+
+#endif
@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "checkpoint.h"
+#include "types.h"
+
+/* ---------- Checkpoints of long encode/decode jobs ---------- */
+
+/* Block size used when re-hashing the part already done */
+#define CHECKPOINT_BLOCK 65536
+
+/*
+ * Function: get_sidecar_name
+ * --------------------------
+ * Builds "<fname><suffix>" (e.g. "stego.y4m.part"). Fails if it does not fit.
+ */
+Status get_sidecar_name(const char *fname, const char *suffix, char *out, size_t size)
+{
+    if (snprintf(out, size, "%s%s", fname, suffix) >= (int)size)
+    {
+        fprintf(stderr, "ERROR: File name %s is too long\n", fname);
+        return e_failure;
+    }
+    return e_success;
+}
+
+/*
+ * Function: get_stream_size
+ * -------------------------
+ * Returns the size of a seekable stream without moving it, -1 for a pipe.
+ */
+long long get_stream_size(FILE *fptr)
+{
+    long pos = ftell(fptr), size;
+
+    if (pos < 0 || fseek(fptr, 0, SEEK_END) != 0)
+        return -1;
+    size = ftell(fptr);
+    if (fseek(fptr, pos, SEEK_SET) != 0)
+        return -1;
+    return size;
+}
+
+/*
+ * Function: hash_input_range
+ * --------------------------
+ * Adds bytes [from, to) of the input to hash. pread is used, so the input
+ * stream and its buffer are left where they are. Stops once the job is
+ * cancelled.
+ */
+static Status hash_input_range(FILE *fptr_in, HashState *hash, long long from, long long to, const Progress *progress)
+{
+    char block[CHECKPOINT_BLOCK];
+    size_t chunk;
+    ssize_t got;
+
+    while (from < to)
+    {
+        if (progress_cancelled(progress))
+            return e_failure;
+        chunk = to - from < (long long)sizeof(block) ? (size_t)(to - from) : sizeof(block);
+        got = pread(fileno(fptr_in), block, chunk, (off_t)from);
+        if (got <= 0)
+            return e_failure;
+        hash_update(hash, block, got);
+        from += got;
+    }
+    return e_success;
+}
+
+/*
+ * Function: capture_checkpoint
+ * ----------------------------
+ * Records where the pixel source and the .part output stand after data_done
+ * secret bytes. Only called between blocks, when every pixel byte read has
+ * been written, so no frame header is pending. Fails for piped streams,
+ * which cannot be resumed.
+ *
+ * input_hash carries the checksum of the input up to the previous
+ * checkpoint; the input read since then is hashed here, so every input
+ * byte is hashed once over the whole job.
+ */
+Status capture_checkpoint(Checkpoint *ckpt, const PixelSource *src, FILE *fptr_part,
+                          long long data_done, const HashState *hash, HashState *input_hash)
+{
+    long in_offset = ftell(src->fptr_in);
+    long out_offset = ftell(fptr_part);
+    HashState next = *input_hash; // kept only once the checkpoint is complete
+
+    if (in_offset < 0 || out_offset < 0 || src->hdr_pending ||
+        hash_input_range(src->fptr_in, &next, ckpt->in_offset, in_offset, src->progress) != e_success)
+        return e_failure;
+
+    memcpy(ckpt->magic, CHECKPOINT_MAGIC, sizeof(ckpt->magic));
+    ckpt->data_done = data_done;
+    ckpt->in_offset = in_offset;
+    ckpt->out_offset = out_offset;
+    ckpt->frame_size = src->frame_size;
+    ckpt->frame_left = src->frame_left;
+    ckpt->frames = src->frames;
+    ckpt->checksum = hash_final(hash);
+    ckpt->input_checksum = hash_final(&next);
+    *input_hash = next;
+    return e_success;
+}
+
+/*
+ * Function: save_checkpoint
+ * -------------------------
+ * Makes the output durable up to the checkpoint, then replaces the sidecar
+ * through a temporary file and a rename, so a crash at any point leaves
+ * either the old or the new checkpoint, never a torn one. The sidecar is
+ * written with plain file descriptor calls: it runs inside the embed loop,
+ * and fopen would allocate on every checkpoint.
+ */
+Status save_checkpoint(const char *ckpt_fname, const Checkpoint *ckpt, FILE *fptr_part)
+{
+    char tmp_fname[CHECKPOINT_PATH];
+    int fd;
+    Status status = e_success;
+
+    if (fflush(fptr_part) != 0 || fsync(fileno(fptr_part)) != 0)
+        return e_failure;
+
+    if (get_sidecar_name(ckpt_fname, ".tmp", tmp_fname, sizeof(tmp_fname)) != e_success)
+        return e_failure;
+    fd = open(tmp_fname, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0)
+        return e_failure;
+
+    if (write(fd, ckpt, sizeof(*ckpt)) != (ssize_t)sizeof(*ckpt) || fsync(fd) != 0)
+        status = e_failure;
+    if (close(fd) != 0)
+        status = e_failure;
+
+    if (status == e_success && rename(tmp_fname, ckpt_fname) != 0)
+        status = e_failure;
+    if (status != e_success)
+        remove(tmp_fname);
+    return status;
+}
+
+/*
+ * Function: load_checkpoint
+ * -------------------------
+ * Reads a sidecar and checks that it was written for an input and a secret
+ * of the given sizes.
+ */
+Status load_checkpoint(const char *ckpt_fname, Checkpoint *ckpt, long long input_size, long long secret_size)
+{
+    FILE *fptr = fopen(ckpt_fname, "r");
+    size_t got;
+
+    if (fptr == NULL)
+        return e_failure; // no checkpoint, nothing to resume
+    got = fread(ckpt, sizeof(*ckpt), 1, fptr);
+    fclose(fptr);
+
+    if (got != 1 || memcmp(ckpt->magic, CHECKPOINT_MAGIC, sizeof(ckpt->magic)) != 0 ||
+        ckpt->input_size != input_size || ckpt->secret_size != secret_size ||
+        ckpt->data_done < 0 || ckpt->data_done > secret_size ||
+        ckpt->in_offset < 0 || ckpt->in_offset > input_size || ckpt->frame_left > ckpt->frame_size)
+    {
+        fprintf(stderr, "WARNING: Checkpoint %s does not belong to this job, starting over\n", ckpt_fname);
+        return e_failure;
+    }
+    return e_success;
+}
+
+/*
+ * Function: verify_checkpoint_data
+ * --------------------------------
+ * Hashes the first data_done bytes of fptr into hash (started here) and
+ * compares them with the checkpoint checksum. The file is left just after
+ * those bytes, and hash can carry on from there. A cancelled job stops
+ * within one block, without a warning.
+ */
+Status verify_checkpoint_data(const Checkpoint *ckpt, FILE *fptr, HashState *hash, const Progress *progress)
+{
+    char block[CHECKPOINT_BLOCK];
+    long long left = ckpt->data_done;
+    size_t chunk;
+
+    hash_init(hash, 0);
+    if (fseek(fptr, 0, SEEK_SET) != 0)
+        return e_failure;
+
+    while (left > 0)
+    {
+        if (progress_cancelled(progress))
+            return e_failure;
+        chunk = left < (long long)sizeof(block) ? (size_t)left : sizeof(block);
+        if (fread(block, 1, chunk, fptr) != chunk)
+            return e_failure;
+        hash_update(hash, block, chunk);
+        left -= chunk;
+    }
+
+    if (hash_final(hash) != ckpt->checksum)
+    {
+        fprintf(stderr, "WARNING: Data before the checkpoint has changed, starting over\n");
+        return e_failure;
+    }
+    return e_success;
+}
+
+/*
+ * Function: verify_checkpoint_input
+ * ---------------------------------
+ * Hashes the input before the checkpoint into input_hash (started here)
+ * and compares it with the checkpoint, so a cover replaced by another file
+ * of the same size is not resumed into a mixed output. input_hash can
+ * carry on from there. A cancelled job stops within one block, without a
+ * warning.
+ */
+Status verify_checkpoint_input(const Checkpoint *ckpt, FILE *fptr_in, HashState *input_hash, const Progress *progress)
+{
+    hash_init(input_hash, 0);
+    if (hash_input_range(fptr_in, input_hash, 0, ckpt->in_offset, progress) != e_success)
+        return e_failure;
+    if (hash_final(input_hash) != ckpt->input_checksum)
+    {
+        fprintf(stderr, "WARNING: Input before the checkpoint has changed, starting over\n");
+        return e_failure;
+    }
+    return e_success;
+}
+
+/*
+ * Function: reopen_part_file
+ * --------------------------
+ * Opens the .part output of an interrupted job for update, provided it
+ * still holds everything the checkpoint says was written. The size is
+ * checked before opening, so the stream is returned untouched and can
+ * still be given its own buffer.
+ */
+Status reopen_part_file(const char *part_fname, const Checkpoint *ckpt, FILE **fptr_part)
+{
+    struct stat st;
+
+    *fptr_part = NULL;
+    if (stat(part_fname, &st) != 0)
+        return e_failure;
+    if (st.st_size < ckpt->out_offset)
+    {
+        fprintf(stderr, "WARNING: %s is shorter than its checkpoint, starting over\n", part_fname);
+        return e_failure;
+    }
+
+    *fptr_part = fopen(part_fname, "r+");
+    return *fptr_part != NULL ? e_success : e_failure;
+}
+
+/*
+ * Function: restore_checkpoint
+ * ----------------------------
+ * Seeks the input to the checkpoint and puts the pixel source back in the
+ * frame it was in. The .part output is cut back to the checkpoint, since
+ * anything written after it may not have reached the disk.
+ */
+Status restore_checkpoint(const Checkpoint *ckpt, PixelSource *src, FILE *fptr_part)
+{
+    if (fseek(src->fptr_in, (long)ckpt->in_offset, SEEK_SET) != 0)
+        return e_failure;
+
+    src->frame_size = ckpt->frame_size;
+    src->frame_left = ckpt->frame_left;
+    src->out_frame_left = ckpt->frame_left; // headers are copied 1:1, so output is in step
+    src->frames = ckpt->frames;
+    src->hdr_pending = 0;
+
+    if (fflush(fptr_part) != 0 || ftruncate(fileno(fptr_part), (off_t)ckpt->out_offset) != 0 ||
+        fseek(fptr_part, (long)ckpt->out_offset, SEEK_SET) != 0)
+        return e_failure;
+
+    printf("Resuming at %lld of %lld secret bytes\n", ckpt->data_done, ckpt->secret_size);
+    return e_success;
+}
+
+/*
+ * Function: finish_part_file
+ * --------------------------
+ * Flushes the finished output to disk and renames it over the final name,
+ * so the output appears complete or not at all. The sidecar (if any) is
+ * removed afterwards.
+ */
+Status finish_part_file(const char *part_fname, const char *fname, const char *ckpt_fname, FILE *fptr_part)
+{
+    if (fflush(fptr_part) != 0 || fsync(fileno(fptr_part)) != 0 || rename(part_fname, fname) != 0)
+    {
+        perror(fname);
+        return e_failure;
+    }
+    if (ckpt_fname != NULL)
+        remove(ckpt_fname);
+    return e_success;
+}
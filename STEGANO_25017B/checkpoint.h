@@ -0,0 +1,70 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdio.h>
+#include "types.h"        // Contains user defined types
+#include "pixel_source.h" // Cover stream backends
+#include "cache.h"        // Running checksum (HashState)
+
+/* Sidecar file identifier and version */
+#define CHECKPOINT_MAGIC "STEGCKP2"
+
+/* Default distance between checkpoints, in pixel bytes */
+#define CHECKPOINT_DEFAULT_INTERVAL (64ULL * 1024 * 1024)
+
+/* Longest file name built for .part and .ckpt files */
+#define CHECKPOINT_PATH 4096
+
+/*
+ * Contents of the .ckpt sidecar: how far a job got, where to pick up in
+ * the pixel stream and what it had seen so far.
+ */
+typedef struct _Checkpoint
+{
+    char magic[8];                   // CHECKPOINT_MAGIC
+    long long input_size;            // Size of the stream being read (identity check)
+    long long secret_size;           // Size of the secret (identity check)
+    long long data_done;             // Secret bytes embedded (or decoded) and written
+    long long in_offset;             // Offset in the input stream after those pixels
+    long long out_offset;            // Length of the .part output up to that point
+    unsigned long long frame_size;   // Pixel source position: bytes per frame
+    unsigned long long frame_left;   // Pixel source position: bytes left in the frame
+    unsigned long frames;            // Pixel source position: frames entered
+    unsigned long long checksum;     // XXH64 of the secret bytes done so far
+    unsigned long long input_checksum; // XXH64 of the input stream before in_offset
+} Checkpoint;
+
+/* Checkpoint function prototypes */
+
+/* Build "<fname><suffix>" for the .part and .ckpt files */
+Status get_sidecar_name(const char *fname, const char *suffix, char *out, size_t size);
+
+/* Size of a seekable stream without moving it, -1 for a pipe */
+long long get_stream_size(FILE *fptr);
+
+/* Record the pixel source position and progress in a checkpoint */
+Status capture_checkpoint(Checkpoint *ckpt, const PixelSource *src, FILE *fptr_part,
+                          long long data_done, const HashState *hash, HashState *input_hash);
+
+/* Flush the output to disk, then atomically replace the sidecar */
+Status save_checkpoint(const char *ckpt_fname, const Checkpoint *ckpt, FILE *fptr_part);
+
+/* Read a sidecar and check it belongs to the given input and secret sizes */
+Status load_checkpoint(const char *ckpt_fname, Checkpoint *ckpt, long long input_size, long long secret_size);
+
+/* Hash the bytes done before the checkpoint and compare them with its checksum */
+Status verify_checkpoint_data(const Checkpoint *ckpt, FILE *fptr, HashState *hash, const Progress *progress);
+
+/* Hash the input before the checkpoint and compare it with its input checksum */
+Status verify_checkpoint_input(const Checkpoint *ckpt, FILE *fptr_in, HashState *input_hash, const Progress *progress);
+
+/* Reopen the .part output of an interrupted job if it holds the checkpointed bytes */
+Status reopen_part_file(const char *part_fname, const Checkpoint *ckpt, FILE **fptr_part);
+
+/* Seek the input to the checkpoint, restore the pixel source and cut the output back */
+Status restore_checkpoint(const Checkpoint *ckpt, PixelSource *src, FILE *fptr_part);
+
+/* Atomically publish a finished .part file and drop its sidecar (if any) */
+Status finish_part_file(const char *part_fname, const char *fname, const char *ckpt_fname, FILE *fptr_part);
+
+#endif
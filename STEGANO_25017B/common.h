@@ -4,4 +4,7 @@
 /* Magic string to identify whether stegged or not */
 #define MAGIC_STRING "#*"
 
+/* Magic string of the slot table at the end of the cover capacity */
+#define SLOT_TABLE_MAGIC "#*ST"
+
 #endif
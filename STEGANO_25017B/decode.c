@@ -1,9 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "decode.h"
 #include "types.h"
 #include "common.h"
+#include "slots.h"
+
+/* Decoded bytes per output write, and stego pixel bytes per read */
+#define DECODE_DATA_BLOCK 4096
+#define DECODE_PIXEL_BLOCK 32768
 
 /* 
  * Function: read_and_validate_decode_args
@@ -17,12 +23,12 @@
  */
 Status read_and_validate_decode_args(char *argv[], DecodeInfo *decInfo)
 {
-    // Validate stego image file (must be .bmp)
-    if (strstr(argv[2], ".bmp") != NULL)
+    // Validate stego image file (must be .bmp, .y4m or .ppm)
+    if (pixel_source_ops_for(argv[2]) != NULL)
         decInfo->stego_image_fname = argv[2];
     else
     {
-        fprintf(stderr, "ERROR: Invalid stego image. Must end with .bmp\n");
+        fprintf(stderr, "ERROR: Invalid stego image. Must end with .bmp, .y4m or .ppm\n");
         return e_failure;
     }
 
@@ -49,17 +55,12 @@ Status open_files_d(DecodeInfo *decInfo)
         fprintf(stderr, "ERROR: Unable to open stego image %s\n", decInfo->stego_image_fname);
         return e_failure;
     }
-    return e_success;
-}
+    workspace_buffer_stream(decInfo->ws, decInfo->fptr_stego_image);
 
-/*
- * Function: skip_bmp_header
- * -------------------------
- * Skips the 54-byte BMP header since actual pixel data starts after it.
- */
-Status skip_bmp_header(FILE *fptr)
-{
-    fseek(fptr, 54, SEEK_SET);
+    // Only reading, so no output stream for the frame headers
+    if (pixel_source_open(&decInfo->src, decInfo->stego_image_fname, decInfo->fptr_stego_image, NULL) != e_success)
+        return e_failure;
+    decInfo->src.progress = decInfo->progress;
     return e_success;
 }
 
@@ -102,7 +103,8 @@ Status decode_magic_string(const char *magic_string, DecodeInfo *decInfo)
 
     for (int i = 0; i < 2; i++) // read 2 characters (##)
     {
-        fread(buffer, 8, 1, decInfo->fptr_stego_image);
+        if (pixel_source_read(&decInfo->src, buffer, 8) != 8)
+            return e_failure;
         decode_byte_from_lsb(&ch, buffer);
         magic_str[i] = ch;
     }
@@ -126,8 +128,14 @@ Status decode_magic_string(const char *magic_string, DecodeInfo *decInfo)
 Status decode_secret_file_extn_size(int *size, DecodeInfo *decInfo)
 {
     char buffer[32];
-    fread(buffer, 32, 1, decInfo->fptr_stego_image); // read 32 bytes
+    if (pixel_source_read(&decInfo->src, buffer, 32) != 32) // read 32 bytes
+        return e_failure;
     decode_size_from_lsb(size, buffer);              // extract size
+    if (*size < 0 || *size >= (int)sizeof(decInfo->extn_secret_file))
+    {
+        fprintf(stderr, "ERROR: Decoded extension size %d is invalid\n", *size);
+        return e_failure;
+    }
     decInfo->extn_size = *size;
     return e_success;
 }
@@ -143,7 +151,8 @@ Status decode_secret_file_extn(DecodeInfo *decInfo)
     char ch;
     for (int i = 0; i < decInfo->extn_size; i++)  // decode character by character
     {
-        fread(buffer, 8, 1, decInfo->fptr_stego_image);
+        if (pixel_source_read(&decInfo->src, buffer, 8) != 8)
+            return e_failure;
         decode_byte_from_lsb(&ch, buffer);
         decInfo->extn_secret_file[i] = ch;
     }
@@ -159,69 +168,227 @@ Status decode_secret_file_extn(DecodeInfo *decInfo)
 Status decode_secret_file_size(long *size, DecodeInfo *decInfo)
 {
     char buffer[32];
-    fread(buffer, 32, 1, decInfo->fptr_stego_image);      // read 32 bytes
-    decode_size_from_lsb((int *)size, buffer);            // extract file size
+    int file_size;
+    if (pixel_source_read(&decInfo->src, buffer, 32) != 32) // read 32 bytes
+        return e_failure;
+    decode_size_from_lsb(&file_size, buffer);             // extract file size
+    if (file_size < 0)
+    {
+        fprintf(stderr, "ERROR: Decoded file size %d is invalid\n", file_size);
+        return e_failure;
+    }
+    *size = file_size;
     decInfo->size_secret_file = *size;
     return e_success;
 }
 
+/*
+ * Function: load_decode_checkpoint
+ * --------------------------------
+ * Looks for the checkpoint of an interrupted run of the same decode. It is
+ * used only if it matches the stego image and secret sizes, and the stego
+ * image and the .part output still hash to its checksums.
+ */
+Status load_decode_checkpoint(DecodeInfo *decInfo)
+{
+    if (load_checkpoint(decInfo->ckpt_fname, &decInfo->ckpt, get_stream_size(decInfo->fptr_stego_image),
+                        decInfo->size_secret_file) != e_success ||
+        verify_checkpoint_input(&decInfo->ckpt, decInfo->fptr_stego_image, &decInfo->input_hash, decInfo->progress) != e_success)
+        return e_failure;
+
+    if (reopen_part_file(decInfo->part_fname, &decInfo->ckpt, &decInfo->fptr_secret) != e_success)
+        return e_failure;
+    workspace_buffer_stream(decInfo->ws, decInfo->fptr_secret);
+    if (verify_checkpoint_data(&decInfo->ckpt, decInfo->fptr_secret, &decInfo->hash, decInfo->progress) != e_success ||
+        restore_checkpoint(&decInfo->ckpt, &decInfo->src, decInfo->fptr_secret) != e_success)
+    {
+        fclose(decInfo->fptr_secret);
+        return e_failure;
+    }
+    return e_success;
+}
+
 /*
  * Function: decode_secret_file_data
  * ---------------------------------
  * Decodes the actual data (contents) of the secret file from the stego image.
+ * The output is written as <name>.part and renamed once complete; every
+ * --checkpoint MB of pixels the progress is saved to <name>.ckpt.
  */
 Status decode_secret_file_data(DecodeInfo *decInfo)
 {
-    char buffer[8];
-    char ch;
-    char output_fname[100] = {0};  // buffer to store output filename
-
-    // Copy base output file name
-    strcpy(output_fname, decInfo->secret_fname);
+    char data[DECODE_DATA_BLOCK];  // decoded bytes, written out one block at a time
+    unsigned long long interval = decInfo->opts != NULL ? decInfo->opts->checkpoint : CHECKPOINT_DEFAULT_INTERVAL;
+    unsigned long long since_ckpt = 0; // pixel bytes read since the last checkpoint
+    long long done;
+    long remaining;
+    size_t chunk;
 
-    // Append decoded file extension
-    strcat(output_fname, decInfo->extn_secret_file);
+    // Output file name: base name followed by the decoded extension, built in the arena
+    decInfo->output_fname = arena_join(&decInfo->ws->arena, decInfo->secret_fname, decInfo->extn_secret_file);
+    if (decInfo->output_fname == NULL)
+        return e_failure;
+    decInfo->part_fname = arena_join(&decInfo->ws->arena, decInfo->output_fname, ".part");
+    decInfo->ckpt_fname = arena_join(&decInfo->ws->arena, decInfo->output_fname, ".ckpt");
+    if (decInfo->part_fname == NULL || decInfo->ckpt_fname == NULL)
+        return e_failure;
 
-    // Open output file for writing decoded data
-    decInfo->fptr_secret = fopen(output_fname, "w");
-    if (!decInfo->fptr_secret)
+    // Open output file for writing decoded data, or reopen the partial output of an interrupted job
+    if (decInfo->opts == NULL || !decInfo->opts->resume || load_decode_checkpoint(decInfo) != e_success)
     {
-        perror("fopen");
-        return e_failure;
+        remove(decInfo->ckpt_fname); // a stale checkpoint must not outlive the output it describes
+        if (progress_cancelled(decInfo->progress))
+        {
+            remove(decInfo->part_fname); // stopped while re-hashing: cleaned up like a cancelled extract
+            return e_failure;
+        }
+        memset(&decInfo->ckpt, 0, sizeof(decInfo->ckpt));
+        hash_init(&decInfo->hash, 0);
+        hash_init(&decInfo->input_hash, 0);
+        decInfo->fptr_secret = fopen(decInfo->part_fname, "w");
+        if (!decInfo->fptr_secret)
+        {
+            perror("fopen");
+            return e_failure;
+        }
+        workspace_buffer_stream(decInfo->ws, decInfo->fptr_secret);
     }
+    decInfo->ckpt.input_size = get_stream_size(decInfo->fptr_stego_image);
+    decInfo->ckpt.secret_size = decInfo->size_secret_file;
 
-    // Decode each byte of secret file data
-    for (int i = 0; i < decInfo->size_secret_file; i++)
+    // Decode the secret file data block by block
+    done = decInfo->ckpt.data_done; // non-zero when resuming
+    progress_stage(decInfo->progress, "extract", (decInfo->size_secret_file - done) * 8ULL);
+    for (remaining = decInfo->size_secret_file - done; remaining > 0; remaining -= chunk)
     {
-        fread(buffer, 8, 1, decInfo->fptr_stego_image);
-        decode_byte_from_lsb(&ch, buffer);
-        fputc(ch, decInfo->fptr_secret);
+        chunk = remaining < (long)sizeof(data) ? (size_t)remaining : sizeof(data);
+        if (decode_data_from_lsb(&decInfo->src, data, chunk) != e_success ||
+            fwrite(data, 1, chunk, decInfo->fptr_secret) != chunk)
+        {
+            fclose(decInfo->fptr_secret);
+            if (progress_cancelled(decInfo->progress))
+                remove(decInfo->ckpt_fname); // a cancelled job cleans up after itself
+            if (access(decInfo->ckpt_fname, F_OK) != 0)
+                remove(decInfo->part_fname); // no checkpoint to resume from
+            return e_failure;
+        }
+        hash_update(&decInfo->hash, data, chunk);
+        done += chunk;
+
+        since_ckpt += chunk * 8ULL;
+        if (interval > 0 && since_ckpt >= interval && remaining > (long)chunk)
+        {
+            since_ckpt = 0;
+            if (capture_checkpoint(&decInfo->ckpt, &decInfo->src, decInfo->fptr_secret, done, &decInfo->hash,
+                                   &decInfo->input_hash) == e_success &&
+                save_checkpoint(decInfo->ckpt_fname, &decInfo->ckpt, decInfo->fptr_secret) != e_success)
+                fprintf(stderr, "WARNING: Unable to save checkpoint %s\n", decInfo->ckpt_fname);
+        }
     }
 
+    if (finish_part_file(decInfo->part_fname, decInfo->output_fname, decInfo->ckpt_fname, decInfo->fptr_secret) != e_success)
+    {
+        fclose(decInfo->fptr_secret);
+        return e_failure;
+    }
     fclose(decInfo->fptr_secret);
-    printf("Decoded file created: %s\n", output_fname);
+    printf("Decoded file created: %s\n", decInfo->output_fname);
+    return e_success;
+}
+
+/*
+ * Function: decode_data_from_lsb
+ * ------------------------------
+ * Decodes size bytes from the LSBs of the next size * 8 stego pixel bytes,
+ * reading whole frame spans at a time.
+ */
+Status decode_data_from_lsb(PixelSource *src, char *data, size_t size)
+{
+    char pixels[DECODE_PIXEL_BLOCK];
+    size_t nbits = size * 8, done, got, bit;
+
+    memset(data, 0, size);
+    for (done = 0; done < nbits; done += got)
+    {
+        got = pixel_source_read_span(src, pixels, nbits - done < sizeof(pixels) ? nbits - done : sizeof(pixels));
+        if (got == 0)
+        {
+            fprintf(stderr, "ERROR: Stego %s ended before the secret was decoded\n", src->ops->name);
+            return e_failure;
+        }
+
+        for (size_t i = 0; i < got; i++)
+        {
+            bit = done + i;
+            data[bit >> 3] |= (pixels[i] & 1) << (bit & 7);  // extract LSBs and combine into bytes
+        }
+
+        // Block boundary: report progress and stop here if the job was cancelled
+        if (progress_add(src->progress, got) != e_success)
+            return e_failure;
+    }
     return e_success;
 }
 
+/*
+ * Function: decode_seek_slot
+ * --------------------------
+ * For "--slot N": looks the slot up in the slot table and moves straight to
+ * its first pixel byte, so the other slots are never read. Slot 0 of an
+ * image without a table is the payload at the start.
+ */
+Status decode_seek_slot(DecodeInfo *decInfo)
+{
+    PixelSource start = decInfo->src;
+    long start_pos = ftell(decInfo->fptr_stego_image);
+    unsigned long long capacity;
+    SlotTable table;
+    int slot = decInfo->opts->slot;
+
+    if (start_pos < 0 || pixel_source_capacity(&decInfo->src, &capacity) != e_success ||
+        read_slot_table(&decInfo->src, &start, start_pos, capacity, &table) != e_success)
+    {
+        if (progress_cancelled(decInfo->progress))
+            return e_failure;
+        if (slot == 0 && start_pos >= 0)
+            return seek_payload_offset(&decInfo->src, &start, start_pos, 0);
+        fprintf(stderr, "ERROR: %s has no slot table\n", decInfo->stego_image_fname);
+        return e_failure;
+    }
+    if ((uint)slot >= table.count)
+    {
+        fprintf(stderr, "ERROR: %s has %u slots, no slot %d\n", decInfo->stego_image_fname, table.count, slot);
+        return e_failure;
+    }
+    return seek_payload_offset(&decInfo->src, &start, start_pos, table.slot[slot].start);
+}
+
 /*
  * Function: do_decoding
  * ---------------------
- * Main decoding process: opens files, skips BMP header, and sequentially decodes
- * magic string, file extension, size, and actual secret data.
+ * Main decoding process: opens files, skips the stream header, and sequentially
+ * decodes magic string, file extension, size, and actual secret data.
  */
 Status do_decoding(DecodeInfo *decInfo)
 {
+    // Names and buffers of the previous job on this workspace are reused
+    workspace_begin_job(decInfo->ws);
+
     if (open_files_d(decInfo) == e_success)
     {
-        skip_bmp_header(decInfo->fptr_stego_image);
-
-        if (decode_magic_string(MAGIC_STRING, decInfo) == e_success)
+        progress_stage(decInfo->progress, "header", 0);
+        if (pixel_source_begin(&decInfo->src) == e_success &&
+            (decInfo->opts == NULL || decInfo->opts->slot < 0 || decode_seek_slot(decInfo) == e_success) &&
+            decode_magic_string(MAGIC_STRING, decInfo) == e_success)
         {
-            decode_secret_file_extn_size(&decInfo->extn_size, decInfo);
-            decode_secret_file_extn(decInfo);
-            decode_secret_file_size(&decInfo->size_secret_file, decInfo);
-            decode_secret_file_data(decInfo);
-            return e_success;
+            if (decode_secret_file_extn_size(&decInfo->extn_size, decInfo) == e_success &&
+                decode_secret_file_extn(decInfo) == e_success &&
+                decode_secret_file_size(&decInfo->size_secret_file, decInfo) == e_success &&
+                decode_secret_file_data(decInfo) == e_success)
+            {
+                progress_finish(decInfo->progress);
+                return e_success;
+            }
         }
     }
     return e_failure;
@@ -3,6 +3,9 @@
 
 #include <stdio.h>     // Standard I/O header for file handling
 #include "types.h"     // Custom header file for type definitions (e.g., Status enum)
+#include "pixel_source.h" // Cover stream backends (BMP, Y4M, PPM)
+#include "checkpoint.h" // Resumable jobs
+#include "arena.h"      // Per-worker workspace
 
 /* Structure to store all decoding-related information */
 typedef struct _DecodeInfo
@@ -15,8 +18,20 @@ typedef struct _DecodeInfo
     int extn_size;                  // Size of the file extension (number of characters)
 
     /* Stego Image Info */
-    char *stego_image_fname;        // Name of the input stego image file (.bmp)
+    char *stego_image_fname;        // Name of the input stego image file (.bmp, .y4m, .ppm)
     FILE *fptr_stego_image;         // File pointer to read stego image data
+    PixelSource src;                // Reads stego pixels frame by frame
+
+    /* Job options and checkpoint of a long job */
+    Options *opts;                  // The --flags given for this job
+    Workspace *ws;                  // The worker's reusable buffers (set by the caller)
+    Progress *progress;             // Progress/cancel state of the job, NULL for none
+    char *output_fname;             // Decoded file name: secret_fname + extension (in the arena)
+    char *part_fname;               // Output written until the job completes (<output>.part)
+    char *ckpt_fname;               // Sidecar recording the progress (<output>.ckpt)
+    Checkpoint ckpt;                // Progress recorded at the last checkpoint
+    HashState hash;                 // Running checksum of the secret bytes decoded
+    HashState input_hash;           // Running checksum of the stego image up to the last checkpoint
 } DecodeInfo;
 
 /* Function Prototypes */
@@ -27,12 +42,12 @@ Status read_and_validate_decode_args(char *argv[], DecodeInfo *decInfo);
 /* Main decoding function that coordinates all decoding steps */
 Status do_decoding(DecodeInfo *decInfo);
 
+/* Moves to the first pixel byte of the slot given with --slot */
+Status decode_seek_slot(DecodeInfo *decInfo);
+
 /* Opens the stego image file for reading */
 Status open_files_d(DecodeInfo *decInfo);
 
-/* Skips the 54-byte BMP header in the image file */
-Status skip_bmp_header(FILE *fptr);
-
 /* Decodes and verifies the magic string from the stego image */
 Status decode_magic_string(const char *magic_string, DecodeInfo *decInfo);
 
@@ -45,6 +60,9 @@ Status decode_secret_file_extn(DecodeInfo *decInfo);
 /* Decodes the total size of the secret file */
 Status decode_secret_file_size(long *size, DecodeInfo *decInfo);
 
+/* Pick up an interrupted decode from its checkpoint, e_failure to start over */
+Status load_decode_checkpoint(DecodeInfo *decInfo);
+
 /* Decodes the actual secret data and writes it to an output file */
 Status decode_secret_file_data(DecodeInfo *decInfo);
 
@@ -54,4 +72,7 @@ Status decode_byte_from_lsb(char *data, char *image_buffer);
 /* Decodes a 32-bit integer (like file size) from the LSBs of image bytes */
 Status decode_size_from_lsb(int *size, char *image_buffer);
 
+/* Decodes a block of bytes from the LSBs of the next stego pixels */
+Status decode_data_from_lsb(PixelSource *src, char *data, size_t size);
+
 #endif   // End of header guard
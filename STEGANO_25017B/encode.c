@@ -1,49 +1,70 @@
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include "encode.h"
 #include "types.h"
 #include "common.h"
+#include "cache.h"
+#include "checkpoint.h"
 
 /* ---------- Function Definitions for Encoding Process ---------- */
 
 int extn_size; // Global variable to hold secret file extension size
 
-/* 
- * Function: get_image_size_for_bmp
- * --------------------------------
- * Reads the width and height from a BMP image header to calculate image capacity.
- * Each pixel in BMP is represented using 3 bytes (R, G, B).
- */
-uint get_image_size_for_bmp(FILE *fptr_image)
-{
-    uint width, height;
-
-    // Move the file pointer to the 18th byte in the BMP header (width position)
-    fseek(fptr_image, 18, SEEK_SET);
-
-    // Read the width (4 bytes)
-    fread(&width, sizeof(int), 1, fptr_image);
-    printf("width = %u\n", width);
-
-    // Read the height (4 bytes)
-    fread(&height, sizeof(int), 1, fptr_image);
-    printf("height = %u\n", height);
-
-    // Return total image size (width * height * 3 bytes per pixel)
-    return width * height * 3;
-}
+/* Cover pixel bytes moved per read/write while embedding data */
+#define ENCODE_PIXEL_BLOCK 32768
 
 /*
  * Function: get_file_size
  * -----------------------
- * Returns the size of a given file in bytes.
+ * Returns the size of a given file in bytes, -1 if it cannot be sized.
+ * Kept as a long so that secrets over 4 GB are not wrapped before the
+ * size check.
  */
-uint get_file_size(FILE *fptr)
+long get_file_size(FILE *fptr)
 {
     fseek(fptr, 0, SEEK_END); // Move to end of file
     return ftell(fptr);       // Return current position (file size)
 }
 
+/*
+ * Function: get_secret_file_extn
+ * ------------------------------
+ * Returns the supported extension (.txt, .c, .sh, .h) found in a secret
+ * file name, or NULL if there is none.
+ */
+char *get_secret_file_extn(char *fname)
+{
+    if (strstr(fname, ".txt") != NULL)
+        return strstr(fname, ".txt");
+    else if (strstr(fname, ".c") != NULL)
+        return strstr(fname, ".c");
+    else if (strstr(fname, ".sh") != NULL)
+        return strstr(fname, ".sh");
+    else if (strstr(fname, ".h") != NULL)
+        return strstr(fname, ".h");
+    return NULL;
+}
+
+/*
+ * Function: store_secret_file_extn
+ * --------------------------------
+ * Copies the extension of a secret file name into a field of the given
+ * size. An extension that does not fit (".txt.bak.txt" in
+ * "notes.txt.bak.txt") is refused instead of overflowing the field.
+ */
+Status store_secret_file_extn(char *extn, size_t size, char *fname)
+{
+    char *found = get_secret_file_extn(fname);
+
+    if (found == NULL || snprintf(extn, size, "%s", found) >= (int)size)
+    {
+        fprintf(stderr, "ERROR: Secret file extension of %s must be at most %zu characters\n", fname, size - 1);
+        return e_failure;
+    }
+    return e_success;
+}
+
 /*
  * Function: read_and_validate_encode_args
  * ---------------------------------------
@@ -66,12 +87,13 @@ Status read_and_validate_encode_args(char *argv[], EncodeInfo *encInfo)
         return e_failure;
     }
 
-    // Check file extension
-    if (strstr(argv[2], ".bmp") != NULL)
+    // Check file extension (BMP image or Y4M/PPM frame stream)
+    const PixelSourceOps *ops = pixel_source_ops_for(argv[2]);
+    if (ops != NULL)
         encInfo->src_image_fname = argv[2];
     else
     {
-        fprintf(stderr, "ERROR: Invalid source file. Must end with '.bmp'\n");
+        fprintf(stderr, "ERROR: Invalid source file. Must end with '.bmp', '.y4m' or '.ppm'\n");
         return e_failure;
     }
 
@@ -89,8 +111,7 @@ Status read_and_validate_encode_args(char *argv[], EncodeInfo *encInfo)
     }
 
     // Acceptable secret file extensions
-    if ((strstr(argv[3], ".txt") != NULL) || (strstr(argv[3], ".c") != NULL) ||
-        (strstr(argv[3], ".sh") != NULL) || (strstr(argv[3], ".h") != NULL))
+    if (get_secret_file_extn(argv[3]) != NULL)
     {
         encInfo->secret_fname = argv[3];
     }
@@ -103,7 +124,10 @@ Status read_and_validate_encode_args(char *argv[], EncodeInfo *encInfo)
     // Optional destination file name
     if (argv[4] == NULL)
     {
-        encInfo->stego_image_fname = "stego.bmp";  // Default output file name
+        // Default output file name, in the same format as the cover
+        static char default_fname[16];
+        snprintf(default_fname, sizeof(default_fname), "stego%s", ops->extn);
+        encInfo->stego_image_fname = default_fname;
     }
     else
     {
@@ -113,13 +137,13 @@ Status read_and_validate_encode_args(char *argv[], EncodeInfo *encInfo)
             return e_failure;
         }
 
-        if (strstr(argv[4], ".bmp") != NULL)
+        if (pixel_source_ops_for(argv[4]) == ops)
         {
             encInfo->stego_image_fname = argv[4];
         }
         else
         {
-            fprintf(stderr, "ERROR: Invalid destination file. Must end with '.bmp'\n");
+            fprintf(stderr, "ERROR: Invalid destination file. Must end with '%s' like the source\n", ops->extn);
             return e_failure;
         }
     }
@@ -134,6 +158,8 @@ Status read_and_validate_encode_args(char *argv[], EncodeInfo *encInfo)
  */
 Status open_files(EncodeInfo *encInfo)
 {
+    encInfo->stego_part_fname = NULL; // nothing to clean up until the output exists
+
     // Open source image
     encInfo->fptr_src_image = fopen(encInfo->src_image_fname, "r");
     if (encInfo->fptr_src_image == NULL)
@@ -142,6 +168,7 @@ Status open_files(EncodeInfo *encInfo)
         fprintf(stderr, "ERROR: Unable to open file %s\n", encInfo->src_image_fname);
         return e_failure;
     }
+    workspace_buffer_stream(encInfo->ws, encInfo->fptr_src_image);
 
     // Open secret file
     encInfo->fptr_secret = fopen(encInfo->secret_fname, "r");
@@ -151,16 +178,63 @@ Status open_files(EncodeInfo *encInfo)
         fprintf(stderr, "ERROR: Unable to open file %s\n", encInfo->secret_fname);
         return e_failure;
     }
+    workspace_buffer_stream(encInfo->ws, encInfo->fptr_secret);
 
-    // Open stego image file
-    encInfo->fptr_stego_image = fopen(encInfo->stego_image_fname, "w");
-    if (encInfo->fptr_stego_image == NULL)
-    {
-        perror("fopen");
-        fprintf(stderr, "ERROR: Unable to open file %s\n", encInfo->stego_image_fname);
+    // The stego image is written as <name>.part and renamed once complete
+    encInfo->ckpt_fname = arena_join(&encInfo->ws->arena, encInfo->stego_image_fname, ".ckpt");
+    if (encInfo->ckpt_fname == NULL)
+        return e_failure;
+    encInfo->stego_part_fname = arena_join(&encInfo->ws->arena, encInfo->stego_image_fname, ".part");
+    if (encInfo->stego_part_fname == NULL)
         return e_failure;
+
+    // Open stego image file, or reopen the partial output of an interrupted job
+    encInfo->resumed = encInfo->opts != NULL && encInfo->opts->resume && load_encode_checkpoint(encInfo) == e_success;
+    if (progress_cancelled(encInfo->progress))
+        return e_failure; // stopped while re-hashing; do_encoding cleans up
+    if (!encInfo->resumed)
+    {
+        remove(encInfo->ckpt_fname); // a stale checkpoint must not outlive the output it describes
+        memset(&encInfo->ckpt, 0, sizeof(encInfo->ckpt));
+        hash_init(&encInfo->hash, 0);
+        hash_init(&encInfo->input_hash, 0);
+        encInfo->fptr_stego_image = fopen(encInfo->stego_part_fname, "w");
+        if (encInfo->fptr_stego_image == NULL)
+        {
+            perror("fopen");
+            fprintf(stderr, "ERROR: Unable to open file %s\n", encInfo->stego_part_fname);
+            return e_failure;
+        }
     }
+    workspace_buffer_stream(encInfo->ws, encInfo->fptr_stego_image);
+    encInfo->ckpt.input_size = get_stream_size(encInfo->fptr_src_image);
+    encInfo->ckpt.secret_size = get_stream_size(encInfo->fptr_secret);
+
+    // Attach the cover backend to the source and stego streams
+    if (pixel_source_open(&encInfo->src, encInfo->src_image_fname,
+                          encInfo->fptr_src_image, encInfo->fptr_stego_image) != e_success)
+        return e_failure;
+    encInfo->src.progress = encInfo->progress;
+    return e_success;
+}
 
+/*
+ * Function: load_encode_checkpoint
+ * --------------------------------
+ * Looks for the checkpoint of an interrupted run of the same job. It is
+ * used only if it matches the cover and secret sizes, the cover and secret
+ * bytes it covers still hash to its checksums and the .part output is intact.
+ */
+Status load_encode_checkpoint(EncodeInfo *encInfo)
+{
+    if (load_checkpoint(encInfo->ckpt_fname, &encInfo->ckpt, get_stream_size(encInfo->fptr_src_image),
+                        get_stream_size(encInfo->fptr_secret)) != e_success)
+        return e_failure;
+
+    if (verify_checkpoint_input(&encInfo->ckpt, encInfo->fptr_src_image, &encInfo->input_hash, encInfo->progress) != e_success ||
+        verify_checkpoint_data(&encInfo->ckpt, encInfo->fptr_secret, &encInfo->hash, encInfo->progress) != e_success ||
+        reopen_part_file(encInfo->stego_part_fname, &encInfo->ckpt, &encInfo->fptr_stego_image) != e_success)
+        return e_failure;
     return e_success;
 }
 
@@ -171,53 +245,49 @@ Status open_files(EncodeInfo *encInfo)
  */
 Status check_capacity(EncodeInfo *encInfo)
 {
-    // Get total bytes available in image
-    encInfo->image_capacity = get_image_size_for_bmp(encInfo->fptr_src_image);
+    printf("width = %u\n", encInfo->src.width);
+    printf("height = %u\n", encInfo->src.height);
 
     // Get secret file size
     encInfo->size_secret_file = get_file_size(encInfo->fptr_secret);
 
-    // Get file extension of secret file
-    char *extn;
-    if (strstr(encInfo->secret_fname, ".txt") != NULL)
-        extn = strstr(encInfo->secret_fname, ".txt");
-    else if (strstr(encInfo->secret_fname, ".c") != NULL)
-        extn = strstr(encInfo->secret_fname, ".c");
-    else if (strstr(encInfo->secret_fname, ".sh") != NULL)
-        extn = strstr(encInfo->secret_fname, ".sh");
-    else if (strstr(encInfo->secret_fname, ".h") != NULL)
-        extn = strstr(encInfo->secret_fname, ".h");
-
-    // Store extension and calculate its size
-    strcpy(encInfo->extn_secret_file, extn);
-    extn_size = strlen(extn);
+    // Store extension of secret file and calculate its size
+    if (store_secret_file_extn(encInfo->extn_secret_file, sizeof(encInfo->extn_secret_file), encInfo->secret_fname) != e_success)
+        return e_failure;
+    extn_size = strlen(encInfo->extn_secret_file);
+
+    // The header stores the size in 32 bits
+    if (encInfo->size_secret_file < 0)
+    {
+        fprintf(stderr, "ERROR: Unable to get the size of %s\n", encInfo->secret_fname);
+        return e_failure;
+    }
+    if (encInfo->size_secret_file > 0x7FFFFFFF)
+    {
+        fprintf(stderr, "ERROR: Secret file is larger than 2 GB\n");
+        return e_failure;
+    }
 
     // Calculate total required bytes for embedding
-    int total_bytes = 54 + (strlen(MAGIC_STRING) * 8) + 32 + (extn_size * 8) + 32 + (encInfo->size_secret_file * 8);
+    unsigned long long total_bytes = (strlen(MAGIC_STRING) * 8) + 32 + (extn_size * 8) + 32 + (encInfo->size_secret_file * 8ULL);
 
-    // Compare capacity and required bytes
-    if (encInfo->image_capacity > total_bytes)
+    // Get total bytes available in the cover; a piped stream is checked while embedding
+    if (pixel_source_capacity(&encInfo->src, &encInfo->image_capacity) != e_success)
+    {
+        if (progress_cancelled(encInfo->progress))
+            return e_failure;
+        printf("INFO: %s cover is not seekable, capacity is checked while embedding\n", encInfo->src.ops->name);
         return e_success;
-    else
-        return e_failure;
-}
-
-/*
- * Function: copy_bmp_header
- * -------------------------
- * Copies the first 54 bytes (BMP header) from source image to destination file.
- */
-Status copy_bmp_header(FILE *fptr_src_image, FILE *fptr_dest_image)
-{
-    rewind(fptr_src_image);
-    unsigned char header[54];  // BMP header is 54 bytes
-    fread(header, sizeof(char), 54, fptr_src_image);
-    fwrite(header, sizeof(char), 54, fptr_dest_image);
+    }
 
-    if (ftell(fptr_dest_image) == ftell(fptr_src_image))
+    // Compare capacity and required bytes
+    if (encInfo->image_capacity >= total_bytes)
         return e_success;
     else
+    {
+        fprintf(stderr, "ERROR: Cover holds %llu bytes, %llu needed\n", encInfo->image_capacity, total_bytes);
         return e_failure;
+    }
 }
 
 /*
@@ -230,9 +300,11 @@ Status encode_magic_string(const char *magic_string, EncodeInfo *encInfo)
     char buffer[8];
     for (size_t i = 0; i < strlen(magic_string); i++)
     {
-        fread(buffer, 8, 1, encInfo->fptr_src_image);
+        if (pixel_source_read(&encInfo->src, buffer, 8) != 8)
+            return e_failure;
         encode_byte_to_lsb(magic_string[i], buffer);
-        fwrite(buffer, 8, 1, encInfo->fptr_stego_image);
+        if (pixel_source_write(&encInfo->src, buffer, 8) != e_success)
+            return e_failure;
     }
     return e_success;
 }
@@ -245,9 +317,11 @@ Status encode_magic_string(const char *magic_string, EncodeInfo *encInfo)
 Status encode_secret_file_extn_size(int size, EncodeInfo *encInfo)
 {
     char buffer[32];
-    fread(buffer, 32, 1, encInfo->fptr_src_image);
+    if (pixel_source_read(&encInfo->src, buffer, 32) != 32)
+        return e_failure;
     encode_size_to_lsb(size, buffer);
-    fwrite(buffer, 32, 1, encInfo->fptr_stego_image);
+    if (pixel_source_write(&encInfo->src, buffer, 32) != e_success)
+        return e_failure;
     return e_success;
 }
 
@@ -261,9 +335,11 @@ Status encode_secret_file_extn(const char *file_extn, EncodeInfo *encInfo)
     char buffer[8];
     for (size_t i = 0; i < strlen(file_extn); i++)
     {
-        fread(buffer, 8, 1, encInfo->fptr_src_image);
+        if (pixel_source_read(&encInfo->src, buffer, 8) != 8)
+            return e_failure;
         encode_byte_to_lsb(file_extn[i], buffer);
-        fwrite(buffer, 8, 1, encInfo->fptr_stego_image);
+        if (pixel_source_write(&encInfo->src, buffer, 8) != e_success)
+            return e_failure;
     }
     return e_success;
 }
@@ -276,43 +352,81 @@ Status encode_secret_file_extn(const char *file_extn, EncodeInfo *encInfo)
 Status encode_secret_file_size(long file_size, EncodeInfo *encInfo)
 {
     char buffer[32];
-    fread(buffer, 32, 1, encInfo->fptr_src_image);
+    if (pixel_source_read(&encInfo->src, buffer, 32) != 32)
+        return e_failure;
     encode_size_to_lsb(file_size, buffer);
-    fwrite(buffer, 32, 1, encInfo->fptr_stego_image);
+    if (pixel_source_write(&encInfo->src, buffer, 32) != e_success)
+        return e_failure;
     return e_success;
 }
 
 /*
- * Function: encode_secret_file_data
- * ---------------------------------
- * Encodes the actual content of the secret file into the image data.
+ * Function: encode_payload_header
+ * -------------------------------
+ * Runs the header stages: magic string, extension size, extension and
+ * secret size.
  */
-Status encode_secret_file_data(EncodeInfo *encInfo)
+Status encode_payload_header(EncodeInfo *encInfo)
 {
-    rewind(encInfo->fptr_secret); // Reset file pointer
-    fread(encInfo->secret_data, encInfo->size_secret_file, 1, encInfo->fptr_secret);
-
-    char buffer[8];
-    for (size_t i = 0; i < encInfo->size_secret_file; i++)
+    if (encode_magic_string(MAGIC_STRING, encInfo) == e_success)
     {
-        fread(buffer, 8, 1, encInfo->fptr_src_image);
-        encode_byte_to_lsb(encInfo->secret_data[i], buffer);
-        fwrite(buffer, 8, 1, encInfo->fptr_stego_image);
+        if (encode_secret_file_extn_size(extn_size, encInfo) == e_success)
+        {
+            if (encode_secret_file_extn(encInfo->extn_secret_file, encInfo) == e_success)
+            {
+                if (encode_secret_file_size(encInfo->size_secret_file, encInfo) == e_success)
+                {
+                    return e_success;
+                }
+            }
+        }
     }
-    return e_success;
+    return e_failure;
 }
 
 /*
- * Function: copy_remaining_img_data
+ * Function: encode_secret_file_data
  * ---------------------------------
- * Copies the remaining bytes of the source image (after encoding) to the output image.
+ * Encodes the actual content of the secret file into the image data.
+ * The secret is streamed through secret_data one buffer at a time, so
+ * payloads larger than the buffer work on long frame streams. Every
+ * --checkpoint MB of pixels the progress is saved to the .ckpt sidecar.
  */
-Status copy_remaining_img_data(FILE *fptr_src, FILE *fptr_dest)
+Status encode_secret_file_data(EncodeInfo *encInfo)
 {
-    char ch;
-    while (fread(&ch, sizeof(char), 1, fptr_src) == 1)
+    unsigned long long interval = encInfo->opts != NULL ? encInfo->opts->checkpoint : CHECKPOINT_DEFAULT_INTERVAL;
+    unsigned long long since_ckpt = 0; // pixel bytes written since the last checkpoint
+    long long done = encInfo->ckpt.data_done; // non-zero when resuming
+    long remaining = encInfo->size_secret_file - done;
+    size_t chunk;
+
+    // Continue after the secret bytes already embedded
+    if (fseek(encInfo->fptr_secret, (long)done, SEEK_SET) != 0)
+        return e_failure;
+    while (remaining > 0)
     {
-        fwrite(&ch, sizeof(char), 1, fptr_dest);
+        chunk = remaining < PAYLOAD_BUFFER_SIZE ? (size_t)remaining : PAYLOAD_BUFFER_SIZE;
+        if (fread(encInfo->secret_data, 1, chunk, encInfo->fptr_secret) != chunk)
+        {
+            fprintf(stderr, "ERROR: Secret file %s changed while encoding\n", encInfo->secret_fname);
+            return e_failure;
+        }
+        if (encode_data_to_lsb(&encInfo->src, encInfo->secret_data, chunk) != e_success)
+            return e_failure;
+        hash_update(&encInfo->hash, encInfo->secret_data, chunk);
+        remaining -= chunk;
+        done += chunk;
+
+        // A piped cover cannot be resumed, so capture fails and nothing is saved
+        since_ckpt += chunk * 8ULL;
+        if (interval > 0 && since_ckpt >= interval && remaining > 0)
+        {
+            since_ckpt = 0;
+            if (capture_checkpoint(&encInfo->ckpt, &encInfo->src, encInfo->fptr_stego_image, done, &encInfo->hash,
+                                   &encInfo->input_hash) == e_success &&
+                save_checkpoint(encInfo->ckpt_fname, &encInfo->ckpt, encInfo->fptr_stego_image) != e_success)
+                fprintf(stderr, "WARNING: Unable to save checkpoint %s\n", encInfo->ckpt_fname);
+        }
     }
     return e_success;
 }
@@ -345,39 +459,177 @@ Status encode_size_to_lsb(int size, char *imageBuffer)
     return e_success;
 }
 
+/*
+ * Function: build_payload_header
+ * ------------------------------
+ * Lays out the embedded header as plain bytes: magic string, extension
+ * size, extension and secret size. The sizes are stored little-endian,
+ * which puts every bit in the same pixel byte as encode_size_to_lsb does,
+ * so the header can be embedded with encode_data_to_lsb like any data.
+ * Returns the header length.
+ */
+uint build_payload_header(char *header, const char *file_extn, long file_size)
+{
+    uint len = 0;
+    uint extn_len = strlen(file_extn);
+
+    memcpy(header + len, MAGIC_STRING, strlen(MAGIC_STRING));
+    len += strlen(MAGIC_STRING);
+    for (int i = 0; i < 4; i++)
+        header[len++] = (extn_len >> (8 * i)) & 0xFF;
+    memcpy(header + len, file_extn, extn_len);
+    len += extn_len;
+    for (int i = 0; i < 4; i++)
+        header[len++] = (file_size >> (8 * i)) & 0xFF;
+    return len;
+}
+
+/*
+ * Function: encode_data_to_lsb
+ * ----------------------------
+ * Encodes a block of bytes into the LSBs of the next size * 8 cover pixel
+ * bytes. Pixels are moved one frame span at a time, so bits of one byte may
+ * land on both sides of a frame boundary.
+ */
+Status encode_data_to_lsb(PixelSource *src, const char *data, size_t size)
+{
+    char pixels[ENCODE_PIXEL_BLOCK];
+    size_t nbits = size * 8, done, got, bit;
+
+    for (done = 0; done < nbits; done += got)
+    {
+        got = pixel_source_read_span(src, pixels, nbits - done < sizeof(pixels) ? nbits - done : sizeof(pixels));
+        if (got == 0)
+        {
+            fprintf(stderr, "ERROR: Cover %s ended before the secret was embedded\n", src->ops->name);
+            return e_failure;
+        }
+
+        for (size_t i = 0; i < got; i++)
+        {
+            bit = done + i;
+            pixels[i] = (pixels[i] & ~1) | ((data[bit >> 3] >> (bit & 7)) & 1);
+        }
+
+        if (pixel_source_write(src, pixels, got) != e_success)
+            return e_failure;
+
+        // Block boundary: report progress and stop here if the job was cancelled
+        if (progress_add(src->progress, got) != e_success)
+            return e_failure;
+    }
+    return e_success;
+}
+
+/*
+ * Function: fetch_cached_result
+ * -----------------------------
+ * Hashes the cover and the secret (one read of each) and looks the
+ * (cover, payload, options) triple up in the result cache. On a hit the
+ * cached stego image is copied next to the output and renamed over it once
+ * complete, and no embedding is done. A failed fetch leaves the .part
+ * output untouched, so encoding can carry on.
+ */
+Status fetch_cached_result(EncodeInfo *encInfo)
+{
+    uint64_t cover_hash, secret_hash;
+    char options[64];
+    char *fetch_fname;
+    const char *extn = pixel_source_ops_for(encInfo->stego_image_fname)->extn;
+
+    // A piped cover cannot be read twice, so it is never cached
+    if (hash_file(encInfo->fptr_src_image, 0, &cover_hash, encInfo->progress) != e_success ||
+        hash_file(encInfo->fptr_secret, cover_hash, &secret_hash, encInfo->progress) != e_success)
+    {
+        encInfo->cache_key[0] = '\0';
+        return e_failure;
+    }
+
+    // Everything else that shapes the output: format, header layout, embedded extension
+    snprintf(options, sizeof(options), "v1|%s|%s|%s", extn, MAGIC_STRING, get_secret_file_extn(encInfo->secret_fname));
+    cache_make_key(encInfo->cache_key, cover_hash, secret_hash, options);
+
+    fetch_fname = arena_join(&encInfo->ws->arena, encInfo->stego_image_fname, ".cache");
+    if (fetch_fname == NULL ||
+        cache_fetch(encInfo->opts->cache_dir, encInfo->cache_key, extn, fetch_fname) != e_success)
+        return e_failure;
+    if (rename(fetch_fname, encInfo->stego_image_fname) != 0)
+    {
+        perror(encInfo->stego_image_fname);
+        remove(fetch_fname);
+        return e_failure;
+    }
+
+    // The output is complete: this run's partial output and checkpoint are of no use
+    remove(encInfo->stego_part_fname);
+    remove(encInfo->ckpt_fname);
+
+    printf("Cache hit: %s\n", encInfo->cache_key);
+    return e_success;
+}
+
 /*
  * Function: do_encoding
  * ---------------------
  * Master function that controls the entire encoding process step by step.
+ * A resumed job skips the header stages and the data already embedded.
  */
 Status do_encoding(EncodeInfo *encInfo)
 {
+    // Names and buffers of the previous job on this workspace are reused
+    workspace_begin_job(encInfo->ws);
+    encInfo->secret_data = encInfo->ws->payload;
+
     if (open_files(encInfo) == e_success)
     {
-        if (check_capacity(encInfo) == e_success)
+        // Identical jobs cost one hash pass when a result cache is configured
+        if (encInfo->opts != NULL && encInfo->opts->cache_dir != NULL && fetch_cached_result(encInfo) == e_success)
+            return e_success;
+
+        // A job cancelled during the hash pass goes straight to the clean-up below
+        if (!progress_cancelled(encInfo->progress) && pixel_source_begin(&encInfo->src) == e_success)
         {
-            if (copy_bmp_header(encInfo->fptr_src_image, encInfo->fptr_stego_image) == e_success)
+            if (check_capacity(encInfo) == e_success)
             {
-                if (encode_magic_string(MAGIC_STRING, encInfo) == e_success)
+                if (!encInfo->resumed)
+                    progress_stage(encInfo->progress, "header", (strlen(MAGIC_STRING) + 8 + extn_size) * 8ULL);
+                if ((encInfo->resumed ? restore_checkpoint(&encInfo->ckpt, &encInfo->src, encInfo->fptr_stego_image)
+                                      : encode_payload_header(encInfo)) == e_success)
                 {
-                    if (encode_secret_file_extn_size(extn_size, encInfo) == e_success)
+                    progress_stage(encInfo->progress, "embed", (encInfo->size_secret_file - encInfo->ckpt.data_done) * 8ULL);
+                    if (encode_secret_file_data(encInfo) == e_success)
                     {
-                        if (encode_secret_file_extn(encInfo->extn_secret_file, encInfo) == e_success)
+                        long pos = ftell(encInfo->fptr_src_image); // -1 for a piped cover: total unknown
+                        progress_stage(encInfo->progress, "copy", pos >= 0 && encInfo->ckpt.input_size > pos ? encInfo->ckpt.input_size - pos : 0);
+                        if (pixel_source_copy_remaining(&encInfo->src) == e_success &&
+                            finish_part_file(encInfo->stego_part_fname, encInfo->stego_image_fname,
+                                             encInfo->ckpt_fname, encInfo->fptr_stego_image) == e_success)
                         {
-                            if (encode_secret_file_size(get_file_size(encInfo->fptr_secret), encInfo) == e_success)
+                            progress_finish(encInfo->progress);
+
+                            // A failure to store the result only costs a later re-encode
+                            if (encInfo->opts != NULL && encInfo->opts->cache_dir != NULL && encInfo->cache_key[0] != '\0')
                             {
-                                if (encode_secret_file_data(encInfo) == e_success)
-                                {
-                                    if (copy_remaining_img_data(encInfo->fptr_src_image, encInfo->fptr_stego_image) == e_success)
-                                    {
-                                        return e_success;
-                                    }
-                                }
+                                cache_store(encInfo->opts->cache_dir, encInfo->cache_key, encInfo->src.ops->extn,
+                                            encInfo->stego_image_fname, encInfo->opts->cache_max);
                             }
+                            return e_success;
                         }
                     }
                 }
             }
         }
     }
+
+    if (encInfo->stego_part_fname != NULL)
+    {
+        // A cancelled job cleans up after itself, checkpoint included
+        if (progress_cancelled(encInfo->progress))
+            remove(encInfo->ckpt_fname);
+
+        // Without a checkpoint the partial output is of no use to a later --resume
+        if (access(encInfo->ckpt_fname, F_OK) != 0)
+            remove(encInfo->stego_part_fname);
+    }
+    return e_failure;
 }
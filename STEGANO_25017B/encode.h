@@ -3,6 +3,12 @@
 #include <stdio.h>
 
 #include "types.h" // Contains user defined types
+#include "pixel_source.h" // Cover stream backends
+#include "checkpoint.h"   // Resumable jobs
+#include "arena.h"        // Per-worker workspace
+
+/* Largest embedded header: magic string, 4-byte extension size, extension, 4-byte secret size */
+#define MAX_PAYLOAD_HEADER 32
 
 /*
  * Structure to store information required for
@@ -16,18 +22,33 @@ typedef struct _EncodeInfo
     /* Source Image info */
     char *src_image_fname; // To store the src image name
     FILE *fptr_src_image;  // To store the address of the src image
-    uint image_capacity;   // To store the size of image
+    unsigned long long image_capacity; // To store the pixel bytes available in the cover
+    PixelSource src;       // To read cover pixels and write stego pixels
 
     /* Secret File Info */
     char *secret_fname;       // To store the secret file name
     FILE *fptr_secret;        // To store the secret file address
     char extn_secret_file[5]; // To store the Secret file extension
-    char secret_data[100000];    // To store the secret data
+    char *secret_data;        // To store the secret data (chunk buffer of the workspace)
     long size_secret_file;    // To store the size of the secret data
 
     /* Stego Image Info */
     char *stego_image_fname; // To store the dest file name
-    FILE *fptr_stego_image;  // To store the address of stego image
+    FILE *fptr_stego_image;  // To store the address of stego image (written as <name>.part)
+    char *stego_part_fname;  // To store the name written until the job completes (in the arena)
+
+    /* Job options */
+    Options *opts;           // To store the --flags given for this job
+    char cache_key[33];      // To store the result cache key (when caching)
+    Workspace *ws;           // To store the worker's reusable buffers (set by the caller)
+    Progress *progress;      // To store the progress/cancel state of the job, NULL for none
+
+    /* Checkpoint of a long job */
+    char *ckpt_fname;        // To store the sidecar name (<stego>.ckpt, in the arena)
+    Checkpoint ckpt;         // To store the progress recorded at the last checkpoint
+    HashState hash;          // To store the running checksum of the secret bytes embedded
+    HashState input_hash;    // To store the running checksum of the cover up to the last checkpoint
+    int resumed;             // Set when continuing from ckpt instead of starting over
 
 } EncodeInfo;
 
@@ -45,14 +66,14 @@ Status open_files(EncodeInfo *encInfo);
 /* check capacity */
 Status check_capacity(EncodeInfo *encInfo);
 
-/* Get image size */
-uint get_image_size_for_bmp(FILE *fptr_image);
-
 /* Get file size */
-uint get_file_size(FILE *fptr);
+long get_file_size(FILE *fptr);
 
-/* Copy bmp image header */
-Status copy_bmp_header(FILE *fptr_src_image, FILE *fptr_dest_image);
+/* Get the supported extension of a secret file name */
+char *get_secret_file_extn(char *fname);
+
+/* Copy the secret file extension into a fixed-size field, refusing one that does not fit */
+Status store_secret_file_extn(char *extn, size_t size, char *fname);
 
 /* Store Magic String */
 Status encode_magic_string(const char *magic_string, EncodeInfo *encInfo);
@@ -66,6 +87,12 @@ Status encode_secret_file_extn(const char *file_extn, EncodeInfo *encInfo);
 /* Encode secret file size */
 Status encode_secret_file_size(long file_size, EncodeInfo *encInfo);
 
+/* Encode the header stages: magic string, extension size, extension, secret size */
+Status encode_payload_header(EncodeInfo *encInfo);
+
+/* Pick up an interrupted job from its checkpoint, e_failure to start over */
+Status load_encode_checkpoint(EncodeInfo *encInfo);
+
 /* Encode secret file data*/
 Status encode_secret_file_data(EncodeInfo *encInfo);
 
@@ -75,7 +102,13 @@ Status encode_byte_to_lsb(char data, char *image_buffer);
 // Encode a size to lsb
 Status encode_size_to_lsb(int size, char *imageBuffer);
 
-/* Copy remaining image bytes from src to stego image after encoding */
-Status copy_remaining_img_data(FILE *fptr_src, FILE *fptr_dest);
+/* Build the embedded header (magic, extension size, extension, secret size) as bytes */
+uint build_payload_header(char *header, const char *file_extn, long file_size);
+
+/* Produce the stego image from the result cache, e_failure on a miss */
+Status fetch_cached_result(EncodeInfo *encInfo);
+
+/* Encode a block of bytes into the LSBs of the next cover pixels */
+Status encode_data_to_lsb(PixelSource *src, const char *data, size_t size);
 
 #endif
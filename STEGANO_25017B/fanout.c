@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "fanout.h"
+#include "encode.h"
+#include "pixel_source.h"
+#include "checkpoint.h"
+#include "arena.h"
+#include "types.h"
+
+/* ---------- Fan-out: one payload embedded into many covers ---------- */
+
+/* Longest stego file name built from a cover name */
+#define FANOUT_PATH 4096
+
+/* Upper bound on worker threads */
+#define FANOUT_MAX_JOBS 256
+
+/*
+ * Function: read_and_validate_fanout_args
+ * ---------------------------------------
+ * Validates "-e --fanout <secret> <cover>...": a supported secret file
+ * followed by one or more supported covers.
+ */
+Status read_and_validate_fanout_args(char *argv[], FanoutInfo *fanInfo)
+{
+    if (argv[2] == NULL || argv[2][0] == '.' || get_secret_file_extn(argv[2]) == NULL)
+    {
+        fprintf(stderr, "ERROR: Invalid secret file. Must end with '.txt', '.c', '.h', or '.sh'\n");
+        return e_failure;
+    }
+    fanInfo->secret_fname = argv[2];
+
+    fanInfo->cover_fnames = &argv[3];
+    for (fanInfo->cover_count = 0; argv[3 + fanInfo->cover_count] != NULL; fanInfo->cover_count++)
+    {
+        if (pixel_source_ops_for(argv[3 + fanInfo->cover_count]) == NULL)
+        {
+            fprintf(stderr, "ERROR: Invalid cover %s. Must end with '.bmp', '.y4m' or '.ppm'\n",
+                    argv[3 + fanInfo->cover_count]);
+            return e_failure;
+        }
+    }
+
+    if (fanInfo->cover_count == 0)
+    {
+        fprintf(stderr, "ERROR: No cover images given.\n");
+        return e_failure;
+    }
+    return e_success;
+}
+
+/*
+ * Function: prepare_fanout_payload
+ * --------------------------------
+ * Reads the secret once and lays out the embedded header followed by the
+ * data in one buffer, shared read-only by all workers.
+ */
+Status prepare_fanout_payload(FanoutInfo *fanInfo)
+{
+    char header[MAX_PAYLOAD_HEADER];
+    uint header_len;
+    FILE *fptr_secret;
+
+    fanInfo->payload = NULL; // do_fanout frees it on every failure
+    fptr_secret = fopen(fanInfo->secret_fname, "r");
+    if (fptr_secret == NULL)
+    {
+        perror("fopen");
+        fprintf(stderr, "ERROR: Unable to open file %s\n", fanInfo->secret_fname);
+        return e_failure;
+    }
+
+    fanInfo->size_secret_file = get_file_size(fptr_secret);
+    if (fanInfo->size_secret_file < 0)
+    {
+        fprintf(stderr, "ERROR: Unable to get the size of %s\n", fanInfo->secret_fname);
+        fclose(fptr_secret);
+        return e_failure;
+    }
+    if (fanInfo->size_secret_file > 0x7FFFFFFF)
+    {
+        fprintf(stderr, "ERROR: Secret file is larger than 2 GB\n");
+        fclose(fptr_secret);
+        return e_failure;
+    }
+    if (store_secret_file_extn(fanInfo->extn_secret_file, sizeof(fanInfo->extn_secret_file), fanInfo->secret_fname) != e_success)
+    {
+        fclose(fptr_secret);
+        return e_failure;
+    }
+    header_len = build_payload_header(header, fanInfo->extn_secret_file, fanInfo->size_secret_file);
+
+    fanInfo->payload_len = header_len + fanInfo->size_secret_file;
+    fanInfo->payload = counted_malloc(fanInfo->payload_len);
+    if (fanInfo->payload == NULL)
+    {
+        fprintf(stderr, "ERROR: Unable to hold a %zu byte payload in memory\n", fanInfo->payload_len);
+        fclose(fptr_secret);
+        return e_failure;
+    }
+
+    memcpy(fanInfo->payload, header, header_len);
+    rewind(fptr_secret);
+    if (fread(fanInfo->payload + header_len, 1, fanInfo->size_secret_file, fptr_secret) != (size_t)fanInfo->size_secret_file)
+    {
+        fprintf(stderr, "ERROR: Unable to read %s\n", fanInfo->secret_fname);
+        fclose(fptr_secret);
+        return e_failure;
+    }
+
+    fclose(fptr_secret);
+    return e_success;
+}
+
+/*
+ * Function: get_fanout_output_name
+ * --------------------------------
+ * Builds the stego name next to the cover: "dir/img.bmp" -> "dir/img_stego.bmp".
+ */
+Status get_fanout_output_name(const char *cover_fname, char *out_fname, size_t size)
+{
+    const char *extn = pixel_source_ops_for(cover_fname)->extn;
+    const char *dot = strrchr(cover_fname, '.');
+    int base_len = dot != NULL ? (int)(dot - cover_fname) : (int)strlen(cover_fname);
+
+    if (snprintf(out_fname, size, "%.*s_stego%s", base_len, cover_fname, extn) >= (int)size)
+        return e_failure;
+    return e_success;
+}
+
+/*
+ * Function: encode_fanout_cover
+ * -----------------------------
+ * Embeds the prepared payload into one cover: header copy, embed and copy
+ * of the remaining pixels. The output is written as <name>.part and
+ * renamed once complete; a failed (or cancelled) output is removed. Both
+ * streams are buffered from the worker's workspace.
+ */
+Status encode_fanout_cover(FanoutInfo *fanInfo, Workspace *ws, Progress *progress, const char *cover_fname)
+{
+    char out_fname[FANOUT_PATH], part_fname[FANOUT_PATH];
+    unsigned long long capacity;
+    long long input_size;
+    long pos;
+    PixelSource src;
+    FILE *fptr_cover, *fptr_stego;
+    Status status = e_failure;
+
+    if (get_fanout_output_name(cover_fname, out_fname, sizeof(out_fname)) != e_success ||
+        get_sidecar_name(out_fname, ".part", part_fname, sizeof(part_fname)) != e_success)
+        return e_failure;
+
+    workspace_begin_job(ws);
+    fptr_cover = fopen(cover_fname, "r");
+    if (fptr_cover == NULL)
+    {
+        perror(cover_fname);
+        return e_failure;
+    }
+    workspace_buffer_stream(ws, fptr_cover);
+    fptr_stego = fopen(part_fname, "w");
+    if (fptr_stego == NULL)
+    {
+        perror(part_fname);
+        fclose(fptr_cover);
+        return e_failure;
+    }
+    workspace_buffer_stream(ws, fptr_stego);
+
+    if (pixel_source_open(&src, cover_fname, fptr_cover, fptr_stego) == e_success &&
+        pixel_source_begin(&src) == e_success)
+    {
+        src.progress = progress;
+        progress->user = (void *)cover_fname; // events are tagged with the cover
+        // A piped cover has no known capacity; running out is caught while embedding
+        if (pixel_source_capacity(&src, &capacity) == e_success && capacity < fanInfo->payload_len * 8ULL)
+            fprintf(stderr, "ERROR: %s holds %llu bytes, %llu needed\n", cover_fname, capacity, fanInfo->payload_len * 8ULL);
+        else
+        {
+            progress_stage(progress, "embed", fanInfo->payload_len * 8ULL);
+            if (encode_data_to_lsb(&src, fanInfo->payload, fanInfo->payload_len) == e_success)
+            {
+                input_size = get_stream_size(fptr_cover);
+                pos = ftell(fptr_cover); // -1 for a piped cover: total unknown
+                progress_stage(progress, "copy", pos >= 0 && input_size > pos ? input_size - pos : 0);
+                if (pixel_source_copy_remaining(&src) == e_success &&
+                    finish_part_file(part_fname, out_fname, NULL, fptr_stego) == e_success)
+                {
+                    progress_finish(progress);
+                    status = e_success;
+                }
+            }
+        }
+    }
+
+    fclose(fptr_cover);
+    if (fclose(fptr_stego) != 0)
+        status = e_failure;
+
+    if (status == e_success)
+        printf("%s -> %s\n", cover_fname, out_fname);
+    else
+    {
+        remove(part_fname);
+        progress->stage = NULL; // the next cover must not report this stage as complete
+    }
+    return status;
+}
+
+/*
+ * Function: fanout_worker
+ * -----------------------
+ * Worker thread: takes the next cover until none are left or the job is
+ * cancelled. The worker owns one workspace, allocated before its first
+ * cover and reused for all of them.
+ */
+static void *fanout_worker(void *arg)
+{
+    FanoutInfo *fanInfo = arg;
+    Workspace ws;
+    Progress progress; // events of each cover (--progress) and the cancel token
+    int idx;
+
+    if (workspace_init(&ws) != e_success)
+        return NULL; // the remaining covers go to the other workers
+    progress_init(&progress, fanInfo->opts != NULL && fanInfo->opts->progress ? progress_print_json : NULL,
+                  NULL, fanInfo->cancel);
+
+    while (!progress_cancelled(&progress) &&
+           (idx = __atomic_fetch_add(&fanInfo->next_cover, 1, __ATOMIC_RELAXED)) < fanInfo->cover_count)
+    {
+        if (encode_fanout_cover(fanInfo, &ws, &progress, fanInfo->cover_fnames[idx]) != e_success)
+            __atomic_fetch_add(&fanInfo->failed, 1, __ATOMIC_RELAXED);
+    }
+
+    workspace_free(&ws);
+    return NULL;
+}
+
+/*
+ * Function: do_fanout
+ * -------------------
+ * Master function for the fan-out: prepares the payload once, then runs
+ * one worker per CPU (or --jobs N) over the covers.
+ */
+Status do_fanout(FanoutInfo *fanInfo)
+{
+    pthread_t workers[FANOUT_MAX_JOBS];
+    unsigned long allocs;
+    int jobs, started, taken;
+
+    if (prepare_fanout_payload(fanInfo) != e_success)
+    {
+        counted_free(fanInfo->payload);
+        return e_failure;
+    }
+
+    jobs = fanInfo->opts->jobs > 0 ? fanInfo->opts->jobs : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs > fanInfo->cover_count)
+        jobs = fanInfo->cover_count;
+    if (jobs > FANOUT_MAX_JOBS)
+        jobs = FANOUT_MAX_JOBS;
+    if (jobs < 1)
+        jobs = 1;
+
+    fanInfo->next_cover = 0;
+    fanInfo->failed = 0;
+    allocs = get_alloc_count();
+    for (started = 0; started < jobs; started++)
+    {
+        if (pthread_create(&workers[started], NULL, fanout_worker, fanInfo) != 0)
+            break;
+    }
+    if (started == 0)
+        fanout_worker(fanInfo); // no threads available, work inline
+
+    for (int i = 0; i < started; i++)
+        pthread_join(workers[i], NULL);
+    allocs = get_alloc_count() - allocs;
+
+    counted_free(fanInfo->payload);
+    fanInfo->payload = NULL;
+
+    // Workers that find no cover left overshoot next_cover; a cancelled run stops short of the end
+    taken = fanInfo->next_cover < fanInfo->cover_count ? fanInfo->next_cover : fanInfo->cover_count;
+    printf("Fan-out: %d of %d covers encoded with %d workers\n",
+           taken - fanInfo->failed, fanInfo->cover_count, started > 0 ? started : 1);
+    // One workspace per worker; the rest are threads and the FILE objects of each cover
+    if (fanInfo->opts->stats)
+        printf("Heap allocations: %lu while encoding, %d of them workspaces\n", allocs, started > 0 ? started : 1);
+
+    // A cover never seen by a worker (cancelled, or all workspaces failed) is a failure too
+    return (taken == fanInfo->cover_count && fanInfo->failed == 0) ? e_success : e_failure;
+}
@@ -0,0 +1,52 @@
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include <stdio.h>
+#include "types.h" // Contains user defined types
+#include "arena.h" // Per-worker workspace
+#include "progress.h" // Cancellation token
+
+/*
+ * Structure to store information required for
+ * embedding one secret into many covers
+ */
+typedef struct _FanoutInfo
+{
+    /* Secret File Info */
+    char *secret_fname;        // To store the secret file name
+    char extn_secret_file[5];  // To store the secret file extension
+    long size_secret_file;     // To store the size of the secret
+
+    /* Payload prepared once: header followed by the secret data */
+    char *payload;             // To store the payload bytes
+    size_t payload_len;        // To store the payload length
+
+    /* Covers */
+    char **cover_fnames;       // To store the cover file names (from argv)
+    int cover_count;           // To store the number of covers
+    int next_cover;            // Next cover handed to a worker
+    int failed;                // Covers that could not be encoded
+
+    /* Job options */
+    Options *opts;             // To store the --flags given for this job
+    CancelToken *cancel;       // To stop the workers, NULL for none
+} FanoutInfo;
+
+/* Fan-out function prototypes */
+
+/* Read and validate fan-out args: the secret followed by the covers */
+Status read_and_validate_fanout_args(char *argv[], FanoutInfo *fanInfo);
+
+/* Perform the fan-out encode */
+Status do_fanout(FanoutInfo *fanInfo);
+
+/* Read the secret once and lay out header + data in memory */
+Status prepare_fanout_payload(FanoutInfo *fanInfo);
+
+/* Build the stego file name for a cover ("img.bmp" -> "img_stego.bmp") */
+Status get_fanout_output_name(const char *cover_fname, char *out_fname, size_t size);
+
+/* Embed the prepared payload into one cover, using the worker's workspace and progress */
+Status encode_fanout_cover(FanoutInfo *fanInfo, Workspace *ws, Progress *progress, const char *cover_fname);
+
+#endif
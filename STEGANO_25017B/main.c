@@ -1,29 +1,109 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "encode.h"
 #include "decode.h"
+#include "update.h"
+#include "analyze.h"
+#include "cache.h"
+#include "fanout.h"
+#include "checkpoint.h"
+#include "arena.h"
+#include "progress.h"
 #include "types.h"
 
 OperationType check_operation_type(char *);//protoype of check_opertion_type function
+Status parse_options(int *argc, char *argv[], Options *opts);//prototype of parse_options function
+void print_alloc_stats(const Options *opts, unsigned long setup_allocs);//prototype of print_alloc_stats function
 
 int main(int argc, char *argv[])
 {
-    if (argc >= 4 && check_operation_type(argv[1]) == e_encode)//argument count should be equal or more than 4 and on index 1 -e or -d should be their
+    Options opts;//--flags given on the command line
+    CancelToken cancel = {0};//set by SIGINT/SIGTERM, checked by the job at block boundaries
+    Progress progress;//progress events of the job
+
+    if (parse_options(&argc, argv, &opts) != e_success)//removes the --flags so the positional arguments keep their index
+    {
+        return e_failure;
+    }
+
+    OperationType operation = argc >= 2 ? check_operation_type(argv[1]) : e_unsupported;//checked once, the branches below only compare
+
+    progress_init(&progress, opts.progress ? progress_print_json : NULL, NULL, &cancel);//--progress prints one JSON line per event
+    if ((operation == e_encode && !opts.append) || operation == e_decode)//append, like -u, does not check the token
+    {
+        cancel_on_signals(&cancel);//Ctrl-C stops the job cleanly, a second Ctrl-C kills it
+    }
+
+    if (argc >= 4 && operation == e_encode && opts.fanout)//fan-out: one secret followed by any number of covers
+    {
+        FanoutInfo fan_info;//structure variable declaration for fan-out
+        fan_info.opts = &opts;
+        fan_info.cancel = &cancel;
+
+        if (read_and_validate_fanout_args(argv, &fan_info) == e_success)
+        {
+            if (do_fanout(&fan_info) != e_success)//payload is prepared once and embedded into all covers in parallel
+            {
+                printf(cancel.cancelled ? "Encoding Cancelled!\n" : "Encoding Failed!\n");
+                return e_failure;
+            }
+            printf("Encoding Successful!\n");
+        }
+        else
+        {
+            printf("Invalid arguments for encoding!\n");
+            return e_failure;
+        }
+    }
+    else if (argc >= 4 && operation == e_encode && opts.append)//append: the existing stego image and the secret for the new slot
+    {
+        UpdateInfo upd_info;//structure variable declaration for append
+
+        if (read_and_validate_update_args(argv, &upd_info) == e_success)
+        {
+            if (do_append(&upd_info) == e_success)//touches only the new slot and the slot table
+            {
+                printf("Append Successful!\n");
+                fclose(upd_info.fptr_secret);
+                fclose(upd_info.fptr_stego_image);
+            }
+            else
+            {
+                printf("Append Failed!\n");
+                return e_failure;
+            }
+        }
+        else
+        {
+            printf("Invalid arguments for append!\n");
+            return e_failure;
+        }
+    }
+    else if (argc >= 4 && operation == e_encode)//argument count should be equal or more than 4 and on index 1 -e or -d should be their
     {
         EncodeInfo enc_info;//structure variable declaration
+        Workspace ws;//buffers and file names of the job, allocated once
+        enc_info.opts = &opts;
+        enc_info.ws = &ws;
+        enc_info.progress = &progress;
 
-        if (read_and_validate_encode_args(argv, &enc_info) == e_success)//checking the passed argument and checking file extension
+        if (read_and_validate_encode_args(argv, &enc_info) == e_success && workspace_init(&ws) == e_success)//checking the passed argument and checking file extension
         {
+            unsigned long setup_allocs = get_alloc_count();
+
             if (do_encoding(&enc_info) == e_success)//after checking argument it will call the encoding function
             {
                 printf("Encoding Successful!\n");//after completing all the operation of encode displaying prompt msg
                 fclose(enc_info.fptr_secret);//closing secret file
                 fclose(enc_info.fptr_src_image);//closing source file
                 fclose(enc_info.fptr_stego_image);//closing dest file
+                print_alloc_stats(&opts, setup_allocs);
+                workspace_free(&ws);
             }
             else
             {
-                printf("Encoding Failed!\n");
+                printf(cancel.cancelled ? "Encoding Cancelled!\n" : "Encoding Failed!\n");//a cancelled job has already removed its output
                 return e_failure;
             }
         }
@@ -33,19 +113,27 @@ int main(int argc, char *argv[])
             return e_failure;//terminate the program
         }
     }
-    else if (argc >= 3 && check_operation_type(argv[1]) == e_decode)//for decoding argument count should be 3 or more than 3 and at 1st index string "-d" should be their
+    else if (argc >= 3 && operation == e_decode)//for decoding argument count should be 3 or more than 3 and at 1st index string "-d" should be their
     {
         DecodeInfo dec_info;//structure variable declaration for decoding
+        Workspace ws;//buffers and file names of the job, allocated once
+        dec_info.opts = &opts;
+        dec_info.ws = &ws;
+        dec_info.progress = &progress;
 
-        if (read_and_validate_decode_args(argv, &dec_info) == e_success)//checking the passed argument and checking file extension
+        if (read_and_validate_decode_args(argv, &dec_info) == e_success && workspace_init(&ws) == e_success)//checking the passed argument and checking file extension
         {
+            unsigned long setup_allocs = get_alloc_count();
+
             if (do_decoding(&dec_info) == e_success)//after checking argument it will call the decoding function
             {
                 printf("Decoding Successful!\n");//after completing all the operation of decode displaying prompt msg
+                print_alloc_stats(&opts, setup_allocs);
+                workspace_free(&ws);
             }
             else
             {
-                printf("Decoding Failed!\n");
+                printf(cancel.cancelled ? "Decoding Cancelled!\n" : "Decoding Failed!\n");
                 return e_failure;
             }
         }
@@ -55,6 +143,48 @@ int main(int argc, char *argv[])
             return e_failure;
         }
     }
+    else if (argc >= 4 && operation == e_update)//for update the existing stego image and the new secret file are needed
+    {
+        UpdateInfo upd_info;//structure variable declaration for in-place update
+
+        if (read_and_validate_update_args(argv, &upd_info) == e_success)
+        {
+            if (do_update(&upd_info) == e_success)//rewrites only the pixel bytes whose LSB changes
+            {
+                printf("Update Successful!\n");
+                fclose(upd_info.fptr_secret);
+                fclose(upd_info.fptr_stego_image);
+            }
+            else
+            {
+                printf("Update Failed!\n");
+                return e_failure;
+            }
+        }
+        else
+        {
+            printf("Invalid arguments for update!\n");
+            return e_failure;
+        }
+    }
+    else if (argc >= 4 && operation == e_analyze)//for analysis a cover and a stego image (or two directories) are needed
+    {
+        AnalyzeInfo ana_info;//structure variable declaration for analysis
+
+        if (read_and_validate_analyze_args(argv, &ana_info) == e_success)
+        {
+            if (do_analysis(&ana_info) != e_success)//prints one report line per cover/stego pair
+            {
+                printf("Analysis Failed!\n");
+                return e_failure;
+            }
+        }
+        else
+        {
+            printf("Invalid arguments for analysis!\n");
+            return e_failure;
+        }
+    }
     else
     {
         
@@ -75,9 +205,98 @@ OperationType check_operation_type(char *symbol)
     {
         return e_decode;
     }
+    else if (strcmp(symbol, "-u") == 0)//for in-place update 1st row consist of "-u" string
+    {
+        return e_update;
+    }
+    else if (strcmp(symbol, "--analyze") == 0)//for analysis 1st row consist of "--analyze" string
+    {
+        return e_analyze;
+    }
     else
     {
         fprintf(stderr, "ERROR: Unsupported operation '%s'\n", symbol);//if that 1st row not consist of "-d" or "-e" it will terminate and show error message
         return e_unsupported;
     }
 }
+
+// Function to move --flags (and their values) from argv into opts
+Status parse_options(int *argc, char *argv[], Options *opts)
+{
+    int kept = 2;//argv[0] and the operation are always kept
+
+    memset(opts, 0, sizeof(*opts));
+    opts->cache_dir = getenv("STEG_CACHE_DIR");//job systems can enable the cache without changing the command line
+    opts->cache_max = CACHE_DEFAULT_MAX;
+    opts->checkpoint = CHECKPOINT_DEFAULT_INTERVAL;
+    opts->slot = -1;
+
+    for (int i = 2; i < *argc; i++)
+    {
+        if (strcmp(argv[i], "--cache") == 0 && i + 1 < *argc)
+        {
+            opts->cache_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--cache-max") == 0 && i + 1 < *argc)
+        {
+            opts->cache_max = strtoull(argv[++i], NULL, 10) * 1024 * 1024;//given in MB
+        }
+        else if (strcmp(argv[i], "--fanout") == 0)
+        {
+            opts->fanout = 1;
+        }
+        else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < *argc)
+        {
+            opts->jobs = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--progress") == 0)
+        {
+            opts->progress = 1;
+        }
+        else if (strcmp(argv[i], "--stats") == 0)
+        {
+            opts->stats = 1;
+        }
+        else if (strcmp(argv[i], "--resume") == 0)
+        {
+            opts->resume = 1;
+        }
+        else if (strcmp(argv[i], "--append") == 0)
+        {
+            opts->append = 1;
+        }
+        else if (strcmp(argv[i], "--slot") == 0 && i + 1 < *argc)
+        {
+            opts->slot = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < *argc)
+        {
+            opts->checkpoint = strtoull(argv[++i], NULL, 10) * 1024 * 1024;//given in MB
+        }
+        else if (strncmp(argv[i], "--", 2) == 0)
+        {
+            fprintf(stderr, "ERROR: Unknown option '%s'\n", argv[i]);
+            return e_failure;
+        }
+        else
+        {
+            argv[kept++] = argv[i];//positional argument
+        }
+    }
+
+    if (*argc > kept)
+    {
+        argv[kept] = NULL;
+        *argc = kept;
+    }
+    return e_success;
+}
+
+// Function to report the heap allocations counted since the workspace was set up
+void print_alloc_stats(const Options *opts, unsigned long setup_allocs)
+{
+    if (opts->stats)
+    {
+        printf("Heap allocations: %lu in setup, %lu while running the job\n", setup_allocs, get_alloc_count() - setup_allocs);
+    }
+}
@@ -0,0 +1,528 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include "pixel_source.h"
+#include "types.h"
+
+/* ---------- Cover stream backends (BMP, Y4M, PPM) ---------- */
+
+/* Smallest frame accepted, so that an 8/32 byte read crosses at most one frame boundary */
+#define MIN_FRAME_SIZE 64
+
+/* Block size used when copying the untouched tail of a stream */
+#define COPY_BLOCK 65536
+
+/*
+ * Function: read_header_line
+ * --------------------------
+ * Reads one '\n' terminated header line into line[] (NUL terminated).
+ * Fails on EOF or if the line does not fit.
+ */
+static Status read_header_line(FILE *fptr, char *line, size_t size, size_t *len)
+{
+    int ch;
+
+    *len = 0;
+    while ((ch = getc(fptr)) != EOF)
+    {
+        if (*len + 1 >= size)
+            return e_failure;
+        line[(*len)++] = ch;
+        if (ch == '\n')
+        {
+            line[*len] = '\0';
+            return e_success;
+        }
+    }
+    return e_failure;
+}
+
+/*
+ * Function: bmp_read_header
+ * -------------------------
+ * Reads the 54-byte BMP header, takes width and height from it and copies
+ * it unchanged to the stego image. A BMP is a single frame of w * h * 3 bytes.
+ */
+static Status bmp_read_header(PixelSource *src)
+{
+    unsigned char header[54]; // BMP header is 54 bytes
+    int width, height;
+
+    rewind(src->fptr_in);
+    if (fread(header, sizeof(char), 54, src->fptr_in) != 54)
+    {
+        fprintf(stderr, "ERROR: BMP header is truncated\n");
+        return e_failure;
+    }
+
+    // Width and height live at byte 18 and 22 of the header
+    memcpy(&width, header + 18, sizeof(int));
+    memcpy(&height, header + 22, sizeof(int));
+    src->width = abs(width);
+    src->height = abs(height); // negative height means a top-down bitmap
+
+    src->frame_size = (unsigned long long)src->width * src->height * 3;
+    src->frame_left = src->frame_size;
+    src->out_frame_left = src->frame_size;
+    src->frames = 1;
+
+    if (src->fptr_out != NULL && fwrite(header, sizeof(char), 54, src->fptr_out) != 54)
+        return e_failure;
+
+    return e_success;
+}
+
+/*
+ * Function: bmp_next_frame
+ * ------------------------
+ * A BMP holds exactly one frame, so there is never a next one.
+ */
+static Status bmp_next_frame(PixelSource *src)
+{
+    (void)src;
+    return e_failure;
+}
+
+/*
+ * Function: y4m_read_header
+ * -------------------------
+ * Parses the "YUV4MPEG2 W.. H.. C.." stream header, works out the size of
+ * one frame from the chroma subsampling and copies the header to the output.
+ */
+static Status y4m_read_header(PixelSource *src)
+{
+    char line[1024];
+    size_t len;
+    char *tok, *save;
+    unsigned long long luma, chroma;
+    const char *colorspace = "420";
+
+    if (read_header_line(src->fptr_in, line, sizeof(line), &len) != e_success ||
+        strncmp(line, "YUV4MPEG2 ", 10) != 0)
+    {
+        fprintf(stderr, "ERROR: Not a YUV4MPEG2 stream\n");
+        return e_failure;
+    }
+
+    if (src->fptr_out != NULL && fwrite(line, sizeof(char), len, src->fptr_out) != len)
+        return e_failure;
+
+    src->width = src->height = 0;
+    for (tok = strtok_r(line + 10, " \n", &save); tok != NULL; tok = strtok_r(NULL, " \n", &save))
+    {
+        if (tok[0] == 'W')
+            src->width = strtoul(tok + 1, NULL, 10);
+        else if (tok[0] == 'H')
+            src->height = strtoul(tok + 1, NULL, 10);
+        else if (tok[0] == 'C')
+            colorspace = tok + 1;
+    }
+
+    // Planes are stored one after another: Y, then the two chroma planes
+    luma = (unsigned long long)src->width * src->height;
+    if (strcmp(colorspace, "420") == 0 || strcmp(colorspace, "420jpeg") == 0 ||
+        strcmp(colorspace, "420paldv") == 0 || strcmp(colorspace, "420mpeg2") == 0)
+        chroma = (unsigned long long)((src->width + 1) / 2) * ((src->height + 1) / 2);
+    else if (strcmp(colorspace, "422") == 0)
+        chroma = (unsigned long long)((src->width + 1) / 2) * src->height;
+    else if (strcmp(colorspace, "444") == 0)
+        chroma = luma;
+    else if (strcmp(colorspace, "mono") == 0)
+        chroma = 0;
+    else if (strrchr(colorspace, 'p') != NULL && isdigit((unsigned char)strrchr(colorspace, 'p')[1]))
+    {
+        // C420p10, C444p12, ...: samples are two bytes and the LSB of the high byte is a visible change
+        fprintf(stderr, "ERROR: Unsupported Y4M colorspace C%s, only 8-bit samples are supported\n", colorspace);
+        return e_failure;
+    }
+    else
+    {
+        fprintf(stderr, "ERROR: Unsupported Y4M colorspace C%s\n", colorspace);
+        return e_failure;
+    }
+
+    src->planar = 1;
+    src->plane_size[0] = luma;
+    src->plane_size[1] = src->plane_size[2] = chroma;
+    src->frame_size = luma + 2 * chroma;
+    src->frame_left = 0; // first FRAME header not read yet
+    src->out_frame_left = 0;
+    src->frames = 0;
+    return e_success;
+}
+
+/*
+ * Function: y4m_next_frame
+ * ------------------------
+ * Reads the "FRAME[ params]\n" line that starts every Y4M frame.
+ */
+static Status y4m_next_frame(PixelSource *src)
+{
+    if (read_header_line(src->fptr_in, src->hdr, sizeof(src->hdr), &src->hdr_len) != e_success)
+        return e_failure; // end of stream
+
+    if (strncmp(src->hdr, "FRAME", 5) != 0)
+    {
+        fprintf(stderr, "ERROR: Bad Y4M frame header after frame %lu\n", src->frames);
+        return e_failure;
+    }
+    return e_success;
+}
+
+/*
+ * Function: ppm_getc
+ * ------------------
+ * Reads one header character and keeps it in hdr[] for pass-through.
+ */
+static int ppm_getc(PixelSource *src)
+{
+    int ch = getc(src->fptr_in);
+
+    if (ch == EOF || src->hdr_len >= sizeof(src->hdr))
+        return EOF;
+    src->hdr[src->hdr_len++] = ch;
+    return ch;
+}
+
+/*
+ * Function: ppm_read_number
+ * -------------------------
+ * Reads one decimal header field, skipping whitespace and '#' comments.
+ * The single whitespace character after the number is consumed.
+ */
+static Status ppm_read_number(PixelSource *src, uint *value)
+{
+    int ch = ppm_getc(src);
+
+    while (ch == '#' || (ch != EOF && isspace(ch)))
+    {
+        if (ch == '#')
+            while (ch != '\n' && ch != EOF)
+                ch = ppm_getc(src);
+        ch = ppm_getc(src);
+    }
+
+    if (ch == EOF || !isdigit(ch))
+        return e_failure;
+
+    *value = 0;
+    while (ch != EOF && isdigit(ch))
+    {
+        *value = *value * 10 + (ch - '0');
+        ch = ppm_getc(src);
+    }
+    return (ch != EOF && isspace(ch)) ? e_success : e_failure;
+}
+
+/*
+ * Function: ppm_next_frame
+ * ------------------------
+ * Reads the "P6 <w> <h> <maxval>" header of the next concatenated PPM frame.
+ * Only 8-bit samples are accepted: with maxval > 255 every sample is two
+ * big-endian bytes, and the LSB of the high byte is a visible change.
+ */
+static Status ppm_next_frame(PixelSource *src)
+{
+    uint maxval;
+    int ch = ppm_getc(src);
+
+    if (ch == EOF)
+        return e_failure; // end of stream
+
+    if (ch != 'P' || ppm_getc(src) != '6' ||
+        ppm_read_number(src, &src->width) != e_success ||
+        ppm_read_number(src, &src->height) != e_success ||
+        ppm_read_number(src, &maxval) != e_success || maxval == 0 || maxval > 65535)
+    {
+        fprintf(stderr, "ERROR: Bad PPM frame header after frame %lu\n", src->frames);
+        return e_failure;
+    }
+    if (maxval > 255)
+    {
+        fprintf(stderr, "ERROR: Unsupported PPM maxval %u after frame %lu, only 8-bit samples are supported\n", maxval, src->frames);
+        return e_failure;
+    }
+
+    src->frame_size = (unsigned long long)src->width * src->height * 3;
+    return e_success;
+}
+
+static Status enter_next_frame(PixelSource *src);
+
+/*
+ * Function: ppm_read_header
+ * -------------------------
+ * A PPM stream has no header of its own; the first frame header is read
+ * and copied straight away so that width and height are known up front.
+ */
+static Status ppm_read_header(PixelSource *src)
+{
+    src->frames = 0;
+    src->out_frame_left = 0;
+    if (enter_next_frame(src) != e_success)
+    {
+        fprintf(stderr, "ERROR: PPM stream has no frames\n");
+        return e_failure;
+    }
+    return e_success;
+}
+
+/* Backend table, looked up by file extension */
+static const PixelSourceOps pixel_source_backends[] =
+{
+    { "bmp", ".bmp", "BGR", bmp_read_header, bmp_next_frame },
+    { "y4m", ".y4m", "YUV", y4m_read_header, y4m_next_frame },
+    { "ppm", ".ppm", "RGB", ppm_read_header, ppm_next_frame },
+};
+
+/*
+ * Function: enter_next_frame
+ * --------------------------
+ * Moves the read side to the next frame. Its header is kept in hdr[] and
+ * written out by pixel_source_write once the previous frame is complete.
+ */
+static Status enter_next_frame(PixelSource *src)
+{
+    src->hdr_len = 0;
+    if (src->ops->next_frame(src) != e_success)
+        return e_failure;
+
+    if (src->frame_size < MIN_FRAME_SIZE)
+    {
+        fprintf(stderr, "ERROR: %s frame %lu is too small to carry data\n", src->ops->name, src->frames);
+        return e_failure;
+    }
+
+    src->frame_left = src->frame_size;
+    src->frames++;
+    src->hdr_pending = (src->fptr_out != NULL);
+    return e_success;
+}
+
+/*
+ * Function: pixel_source_ops_for
+ * ------------------------------
+ * Picks the backend matching the extension of the given file name.
+ */
+const PixelSourceOps *pixel_source_ops_for(const char *fname)
+{
+    for (size_t i = 0; i < sizeof(pixel_source_backends) / sizeof(pixel_source_backends[0]); i++)
+    {
+        if (strstr(fname, pixel_source_backends[i].extn) != NULL)
+            return &pixel_source_backends[i];
+    }
+    return NULL;
+}
+
+/*
+ * Function: pixel_source_open
+ * ---------------------------
+ * Attaches a pixel source to already opened streams. fptr_out may be NULL
+ * when the stream is only read (decoding).
+ */
+Status pixel_source_open(PixelSource *src, const char *fname, FILE *fptr_in, FILE *fptr_out)
+{
+    memset(src, 0, sizeof(*src));
+    src->ops = pixel_source_ops_for(fname);
+    if (src->ops == NULL)
+    {
+        fprintf(stderr, "ERROR: Unsupported cover format %s\n", fname);
+        return e_failure;
+    }
+    src->fptr_in = fptr_in;
+    src->fptr_out = fptr_out;
+    return e_success;
+}
+
+/*
+ * Function: pixel_source_begin
+ * ----------------------------
+ * Reads the stream header and copies it to the output, if any.
+ */
+Status pixel_source_begin(PixelSource *src)
+{
+    if (src->ops->read_header(src) != e_success)
+        return e_failure;
+
+    // The first header of a frame stream goes out immediately
+    if (src->hdr_pending)
+    {
+        if (fwrite(src->hdr, sizeof(char), src->hdr_len, src->fptr_out) != src->hdr_len)
+            return e_failure;
+        src->hdr_pending = 0;
+        src->out_frame_left = src->frame_size;
+    }
+    return e_success;
+}
+
+/*
+ * Function: pixel_source_capacity
+ * -------------------------------
+ * Counts the pixel bytes left in the cover by seeking over the frames.
+ * Fails when the stream cannot seek (pipe), in which case the capacity is
+ * only known once the stream ends, and when the job is cancelled during
+ * the walk (checked every frame).
+ */
+Status pixel_source_capacity(PixelSource *src, unsigned long long *capacity)
+{
+    PixelSource saved = *src;
+    long pos = ftell(src->fptr_in);
+
+    if (pos < 0)
+        return e_failure;
+
+    *capacity = src->frame_left;
+    src->fptr_out = NULL; // headers are only parsed, never copied, while walking
+    while (!progress_cancelled(src->progress) &&
+           fseek(src->fptr_in, (long)src->frame_left, SEEK_CUR) == 0 && enter_next_frame(src) == e_success)
+        *capacity += src->frame_size;
+
+    *src = saved;
+    if (fseek(src->fptr_in, pos, SEEK_SET) != 0 || progress_cancelled(src->progress))
+        return e_failure;
+    return e_success;
+}
+
+/*
+ * Function: pixel_source_span
+ * ---------------------------
+ * Returns the pixel bytes left in the current frame, entering the next frame
+ * first if the current one is used up. The file position is then at the
+ * first of those bytes. Returns 0 at the end of the stream.
+ */
+unsigned long long pixel_source_span(PixelSource *src)
+{
+    if (src->frame_left == 0)
+    {
+        // The previous frame header must be written before entering another frame
+        if (src->hdr_pending || enter_next_frame(src) != e_success)
+            return 0;
+    }
+    return src->frame_left;
+}
+
+/*
+ * Function: pixel_source_skip
+ * ---------------------------
+ * Moves n pixel bytes forward by seeking, frame by frame. Only for sources
+ * without an output stream (decoding, in-place updates), since the skipped
+ * bytes are not copied anywhere.
+ */
+Status pixel_source_skip(PixelSource *src, unsigned long long n)
+{
+    unsigned long long span, step;
+
+    while (n > 0)
+    {
+        span = pixel_source_span(src);
+        if (span == 0)
+            return e_failure;
+        step = n < span ? n : span;
+        if (fseek(src->fptr_in, (long)step, SEEK_CUR) != 0)
+            return e_failure;
+        src->frame_left -= step;
+        n -= step;
+    }
+    return e_success;
+}
+
+/*
+ * Function: pixel_source_read_span
+ * --------------------------------
+ * Reads up to n pixel bytes from the current frame, entering the next frame
+ * first if the current one is used up. Never crosses a frame boundary, so
+ * the bytes returned are contiguous in the file.
+ */
+size_t pixel_source_read_span(PixelSource *src, char *buf, size_t n)
+{
+    size_t got;
+
+    if (pixel_source_span(src) == 0)
+        return 0;
+
+    if (n > src->frame_left)
+        n = src->frame_left;
+    got = fread(buf, sizeof(char), n, src->fptr_in);
+    src->frame_left -= got;
+    return got;
+}
+
+/*
+ * Function: pixel_source_read
+ * ---------------------------
+ * Reads n pixel bytes, crossing frame boundaries as needed. Returns fewer
+ * bytes only when the stream ends.
+ */
+size_t pixel_source_read(PixelSource *src, char *buf, size_t n)
+{
+    size_t done = 0, got;
+
+    while (done < n && (got = pixel_source_read_span(src, buf + done, n - done)) > 0)
+        done += got;
+    return done;
+}
+
+/*
+ * Function: pixel_source_write
+ * ----------------------------
+ * Writes pixel bytes to the output in the order they were read, putting the
+ * pending frame header in front of the first byte of the new frame.
+ */
+Status pixel_source_write(PixelSource *src, const char *buf, size_t n)
+{
+    size_t chunk;
+
+    while (n > 0)
+    {
+        if (src->out_frame_left == 0)
+        {
+            if (!src->hdr_pending)
+            {
+                fprintf(stderr, "ERROR: Pixel data written past the end of the %s stream\n", src->ops->name);
+                return e_failure;
+            }
+            if (fwrite(src->hdr, sizeof(char), src->hdr_len, src->fptr_out) != src->hdr_len)
+                return e_failure;
+            src->hdr_pending = 0;
+            src->out_frame_left = src->frame_size;
+        }
+
+        chunk = n < src->out_frame_left ? n : src->out_frame_left;
+        if (fwrite(buf, sizeof(char), chunk, src->fptr_out) != chunk)
+            return e_failure;
+        buf += chunk;
+        n -= chunk;
+        src->out_frame_left -= chunk;
+    }
+    return e_success;
+}
+
+/*
+ * Function: pixel_source_copy_remaining
+ * -------------------------------------
+ * Copies the rest of the stream (remaining pixels and any later frames with
+ * their headers) unchanged to the output, one block at a time. Stops after
+ * the current block when the job is cancelled.
+ */
+Status pixel_source_copy_remaining(PixelSource *src)
+{
+    char block[COPY_BLOCK];
+    size_t got;
+
+    if (src->hdr_pending)
+    {
+        if (fwrite(src->hdr, sizeof(char), src->hdr_len, src->fptr_out) != src->hdr_len)
+            return e_failure;
+        src->hdr_pending = 0;
+    }
+
+    while ((got = fread(block, sizeof(char), sizeof(block), src->fptr_in)) > 0)
+    {
+        if (fwrite(block, sizeof(char), got, src->fptr_out) != got)
+            return e_failure;
+        if (progress_add(src->progress, got) != e_success)
+            return e_failure;
+    }
+    return ferror(src->fptr_in) ? e_failure : e_success;
+}
@@ -0,0 +1,85 @@
+#ifndef PIXEL_SOURCE_H
+#define PIXEL_SOURCE_H
+
+#include <stdio.h>
+#include "types.h" // Contains user defined types
+#include "progress.h" // Progress events and cancellation
+
+/* Largest frame header line we pass through (Y4M "FRAME..." / PPM "P6 w h max") */
+#define MAX_FRAME_HEADER 256
+
+typedef struct _PixelSource PixelSource;
+
+/*
+ * Backend operations for one cover format.
+ * A backend only parses headers; pixel bytes are moved by the
+ * generic pixel_source_* functions below.
+ */
+typedef struct _PixelSourceOps
+{
+    const char *name;                        // Format name (e.g. "bmp")
+    const char *extn;                        // File extension (e.g. ".bmp")
+    const char *channels;                    // Channel letters in storage order (e.g. "BGR")
+    Status (*read_header)(PixelSource *src); // Parse the stream header, copy it to fptr_out
+    Status (*next_frame)(PixelSource *src);  // Parse the next frame header into hdr[]
+} PixelSourceOps;
+
+/*
+ * Structure to store the state of a cover stream.
+ * Pixel bytes are read frame by frame; frame headers are held in hdr[]
+ * until the pixel bytes before them have been written out, so memory
+ * stays bounded whatever the length of the stream.
+ */
+struct _PixelSource
+{
+    const PixelSourceOps *ops; // Backend for the cover format
+    FILE *fptr_in;             // Cover (or stego) stream being read
+    FILE *fptr_out;            // Stego stream being written, NULL when only reading
+
+    uint width;                // Frame width in pixels
+    uint height;               // Frame height in pixels
+    unsigned long long frame_size;     // Pixel bytes per frame
+    unsigned long long frame_left;     // Pixel bytes left to read in the current frame
+    unsigned long long out_frame_left; // Pixel bytes left to write in the current frame
+    unsigned long frames;      // Frames entered so far
+    int planar;                // Channels stored as whole planes (Y4M) instead of interleaved
+    unsigned long long plane_size[3]; // Bytes per plane when planar
+
+    char hdr[MAX_FRAME_HEADER]; // Header of the frame being entered
+    size_t hdr_len;             // Length of hdr[]
+    int hdr_pending;            // hdr[] still has to be written to fptr_out
+
+    Progress *progress;         // Counts pixel bytes moved and holds the cancel token, NULL for none
+};
+
+/* Find the backend for a file name by its extension, NULL if unsupported */
+const PixelSourceOps *pixel_source_ops_for(const char *fname);
+
+/* Attach a pixel source to already opened streams */
+Status pixel_source_open(PixelSource *src, const char *fname, FILE *fptr_in, FILE *fptr_out);
+
+/* Read the stream header (copying it to the output, if any) */
+Status pixel_source_begin(PixelSource *src);
+
+/* Total pixel bytes of a seekable cover, e_failure if it cannot be known in advance */
+Status pixel_source_capacity(PixelSource *src, unsigned long long *capacity);
+
+/* Pixel bytes left in the current frame, entering the next frame if needed (0 at end) */
+unsigned long long pixel_source_span(PixelSource *src);
+
+/* Skip n pixel bytes of a stream that is only read or updated in place */
+Status pixel_source_skip(PixelSource *src, unsigned long long n);
+
+/* Read up to n pixel bytes, crossing at most one frame boundary */
+size_t pixel_source_read(PixelSource *src, char *buf, size_t n);
+
+/* Read up to n pixel bytes without crossing the end of the current frame */
+size_t pixel_source_read_span(PixelSource *src, char *buf, size_t n);
+
+/* Write pixel bytes previously read, emitting frame headers in between */
+Status pixel_source_write(PixelSource *src, const char *buf, size_t n);
+
+/* Copy the rest of the stream unchanged to the output */
+Status pixel_source_copy_remaining(PixelSource *src);
+
+#endif
@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include "progress.h"
+#include "types.h"
+
+/* ---------- Progress events and cooperative cancellation ---------- */
+
+/* Token set by the signal handler */
+static CancelToken *signal_token;
+
+/*
+ * Function: elapsed_seconds
+ * -------------------------
+ * Seconds from start to end.
+ */
+static double elapsed_seconds(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * Function: emit_event
+ * --------------------
+ * Hands the current state of the stage to the callback, with the
+ * throughput since the previous event.
+ */
+static void emit_event(Progress *progress, const struct timespec *now)
+{
+    ProgressEvent event;
+    double seconds = elapsed_seconds(&progress->last_time, now);
+
+    event.stage = progress->stage;
+    event.done = progress->done;
+    event.total = progress->total;
+    event.mbps = seconds > 0 ? (progress->done - progress->last_done) / seconds / 1e6 : 0;
+    progress->callback(&event, progress->user);
+
+    progress->last_done = progress->done;
+    progress->last_time = *now;
+}
+
+/*
+ * Function: progress_init
+ * -----------------------
+ * Sets up the progress of a job. callback and cancel may be NULL.
+ */
+void progress_init(Progress *progress, ProgressCallback callback, void *user, CancelToken *cancel)
+{
+    memset(progress, 0, sizeof(*progress));
+    progress->callback = callback;
+    progress->user = user;
+    progress->cancel = cancel;
+}
+
+/*
+ * Function: progress_stage
+ * ------------------------
+ * Reports the current stage as complete and starts the next one with an
+ * event at 0 bytes. A NULL progress is ignored.
+ */
+void progress_stage(Progress *progress, const char *stage, unsigned long long total)
+{
+    struct timespec now;
+
+    if (progress == NULL)
+        return;
+
+    progress_finish(progress);
+    progress->stage = stage;
+    progress->done = 0;
+    progress->total = total;
+    progress->last_done = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    progress->last_time = now;
+    if (progress->callback != NULL)
+        emit_event(progress, &now);
+}
+
+/*
+ * Function: progress_add
+ * ----------------------
+ * Counts bytes done at a block boundary. An event is emitted at most every
+ * PROGRESS_INTERVAL_MS. Returns e_failure once the job is cancelled, so the
+ * caller stops before the next block.
+ */
+Status progress_add(Progress *progress, unsigned long long bytes)
+{
+    struct timespec now;
+
+    if (progress == NULL)
+        return e_success;
+
+    progress->done += bytes;
+    if (progress->callback != NULL)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (elapsed_seconds(&progress->last_time, &now) * 1000 >= PROGRESS_INTERVAL_MS)
+            emit_event(progress, &now);
+    }
+    return progress_cancelled(progress) ? e_failure : e_success;
+}
+
+/*
+ * Function: progress_finish
+ * -------------------------
+ * Reports the current stage as complete (done = total when the total is known).
+ */
+void progress_finish(Progress *progress)
+{
+    struct timespec now;
+
+    if (progress == NULL || progress->stage == NULL)
+        return;
+
+    if (progress->total > progress->done)
+        progress->done = progress->total;
+    if (progress->callback != NULL)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        emit_event(progress, &now);
+    }
+    progress->stage = NULL;
+}
+
+/*
+ * Function: progress_cancelled
+ * ----------------------------
+ * Returns non-zero once the job has been asked to stop.
+ */
+int progress_cancelled(const Progress *progress)
+{
+    return progress != NULL && progress->cancel != NULL && progress->cancel->cancelled;
+}
+
+/*
+ * Function: cancel_job
+ * --------------------
+ * Asks the job(s) using this token to stop at their next block boundary.
+ * Safe to call from a callback, another thread or a signal handler.
+ */
+void cancel_job(CancelToken *cancel)
+{
+    cancel->cancelled = 1;
+}
+
+/*
+ * Function: cancel_signal_handler
+ * -------------------------------
+ * First SIGINT/SIGTERM: cancel the job. The handler is then reset, so a
+ * second signal ends the process the usual way.
+ */
+static void cancel_signal_handler(int signum)
+{
+    (void)signum;
+    if (signal_token != NULL)
+        cancel_job(signal_token);
+}
+
+/*
+ * Function: cancel_on_signals
+ * ---------------------------
+ * Routes SIGINT and SIGTERM to the cancellation token.
+ */
+Status cancel_on_signals(CancelToken *cancel)
+{
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = cancel_signal_handler;
+    sa.sa_flags = SA_RESETHAND;
+    sigemptyset(&sa.sa_mask);
+
+    signal_token = cancel;
+    if (sigaction(SIGINT, &sa, NULL) != 0 || sigaction(SIGTERM, &sa, NULL) != 0)
+        return e_failure;
+    return e_success;
+}
+
+/*
+ * Function: progress_print_json
+ * -----------------------------
+ * Writes an event as one line of JSON on stderr, for orchestrators. When
+ * user is a cover name (fan-out) it is added as "cover", so the events of
+ * parallel workers can be told apart. The line is written under the
+ * stream lock, so lines of different workers never interleave.
+ */
+void progress_print_json(const ProgressEvent *event, void *user)
+{
+    const unsigned char *name = user;
+
+    flockfile(stderr);
+    fputc('{', stderr);
+    if (name != NULL)
+    {
+        fputs("\"cover\":\"", stderr);
+        for (; *name != '\0'; name++)
+        {
+            if (*name == '"' || *name == '\\')
+                fprintf(stderr, "\\%c", *name);
+            else if (*name < 0x20)
+                fprintf(stderr, "\\u%04x", *name);
+            else
+                fputc(*name, stderr);
+        }
+        fputs("\",", stderr);
+    }
+    fprintf(stderr, "\"stage\":\"%s\",\"done\":%llu,\"total\":%llu,\"mbps\":%.1f}\n",
+            event->stage, event->done, event->total, event->mbps);
+    funlockfile(stderr);
+}
@@ -0,0 +1,72 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <signal.h>
+#include <time.h>
+#include "types.h" // Contains user defined types
+
+/* Shortest time between two events of the same stage */
+#define PROGRESS_INTERVAL_MS 200
+
+/* Cancellation token: set from a signal handler or another thread */
+typedef struct _CancelToken
+{
+    volatile sig_atomic_t cancelled; // Non-zero once the job has to stop
+} CancelToken;
+
+/* One progress event */
+typedef struct _ProgressEvent
+{
+    const char *stage;          // Stage name ("header", "embed", "extract", "copy")
+    unsigned long long done;    // Bytes of the stage done so far
+    unsigned long long total;   // Bytes of the stage in all, 0 when unknown (pipes)
+    double mbps;                // Throughput since the previous event, in MB/s
+} ProgressEvent;
+
+/* Receives the events of a job */
+typedef void (*ProgressCallback)(const ProgressEvent *event, void *user);
+
+/*
+ * Progress state of one job. A pixel source that has one counts the pixel
+ * bytes it moves and checks the cancellation token at block boundaries.
+ */
+typedef struct _Progress
+{
+    ProgressCallback callback;      // Event receiver, NULL for none
+    void *user;                     // Passed to the callback
+    CancelToken *cancel;            // Token checked at block boundaries, NULL for none
+
+    const char *stage;              // Current stage, NULL before the first
+    unsigned long long done;        // Bytes of the current stage done
+    unsigned long long total;       // Bytes of the current stage in all
+    unsigned long long last_done;   // done at the previous event
+    struct timespec last_time;      // Time of the previous event
+} Progress;
+
+/* Progress function prototypes */
+
+/* Set up the progress of a job */
+void progress_init(Progress *progress, ProgressCallback callback, void *user, CancelToken *cancel);
+
+/* Finish the current stage (if any) and start the next one */
+void progress_stage(Progress *progress, const char *stage, unsigned long long total);
+
+/* Count bytes done in the current stage; e_failure once the job is cancelled */
+Status progress_add(Progress *progress, unsigned long long bytes);
+
+/* Finish the last stage */
+void progress_finish(Progress *progress);
+
+/* Whether the job has been asked to stop */
+int progress_cancelled(const Progress *progress);
+
+/* Ask a job to stop at its next block boundary */
+void cancel_job(CancelToken *cancel);
+
+/* Cancel token on SIGINT/SIGTERM (a second signal ends the process) */
+Status cancel_on_signals(CancelToken *cancel);
+
+/* CLI callback: one JSON line per event on stderr; user is the cover name (or NULL) */
+void progress_print_json(const ProgressEvent *event, void *user);
+
+#endif
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <string.h>
+#include "slots.h"
+#include "decode.h"
+#include "types.h"
+#include "common.h"
+
+/* ---------- Slot table of appendable payloads ---------- */
+
+/* Longest embedded extension, as accepted by the decoder */
+#define SLOT_MAX_EXTN 9
+
+/*
+ * Function: get_u32
+ * -----------------
+ * Reads a little-endian 32-bit value, the byte order of all embedded sizes.
+ */
+static uint get_u32(const char *buf)
+{
+    const unsigned char *p = (const unsigned char *)buf;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint)p[3] << 24);
+}
+
+static void put_u32(char *buf, uint value)
+{
+    for (int i = 0; i < 4; i++)
+        buf[i] = (value >> (8 * i)) & 0xFF;
+}
+
+/*
+ * Function: seek_payload_offset
+ * -----------------------------
+ * Puts the pixel source back in the state it had at the first pixel byte
+ * (saved right after pixel_source_begin) and skips to the given payload byte.
+ */
+Status seek_payload_offset(PixelSource *src, const PixelSource *start, long start_pos, unsigned long long offset)
+{
+    *src = *start;
+    if (fseek(src->fptr_in, start_pos, SEEK_SET) != 0)
+        return e_failure;
+    return pixel_source_skip(src, offset * 8);
+}
+
+/*
+ * Function: get_slot_table_offset
+ * -------------------------------
+ * The table takes the last SLOT_TABLE_SIZE payload bytes of the cover.
+ */
+Status get_slot_table_offset(unsigned long long capacity, unsigned long long *offset)
+{
+    if (capacity / 8 < SLOT_TABLE_SIZE)
+        return e_failure;
+    *offset = capacity / 8 - SLOT_TABLE_SIZE;
+    return e_success;
+}
+
+/*
+ * Function: read_slot_table
+ * -------------------------
+ * Reads the table at the end of the capacity and checks it: magic string,
+ * slot 0 at the start, slots in order without overlap and all of them in
+ * front of the table. Fails (quietly) when the image has no table.
+ */
+Status read_slot_table(PixelSource *src, const PixelSource *start, long start_pos,
+                       unsigned long long capacity, SlotTable *table)
+{
+    char buf[SLOT_TABLE_SIZE];
+    unsigned long long table_offset, end = 0;
+
+    if (get_slot_table_offset(capacity, &table_offset) != e_success ||
+        seek_payload_offset(src, start, start_pos, table_offset) != e_success ||
+        decode_data_from_lsb(src, buf, sizeof(buf)) != e_success)
+        return e_failure;
+
+    if (memcmp(buf, SLOT_TABLE_MAGIC, 4) != 0)
+        return e_failure;
+    table->count = get_u32(buf + 4);
+    if (table->count < 1 || table->count > MAX_SLOTS)
+        return e_failure;
+
+    for (uint i = 0; i < table->count; i++)
+    {
+        table->slot[i].start = get_u32(buf + 8 + 8 * i);
+        table->slot[i].length = get_u32(buf + 12 + 8 * i);
+        if ((i == 0 && table->slot[i].start != 0) || table->slot[i].start < end ||
+            (unsigned long long)table->slot[i].start + table->slot[i].length > table_offset)
+            return e_failure;
+        end = (unsigned long long)table->slot[i].start + table->slot[i].length;
+    }
+    return e_success;
+}
+
+/*
+ * Function: build_slot_table
+ * --------------------------
+ * Lays out the table as plain bytes, little-endian like the payload header.
+ * Unused entries are zero.
+ */
+void build_slot_table(char *buf, const SlotTable *table)
+{
+    memset(buf, 0, SLOT_TABLE_SIZE);
+    memcpy(buf, SLOT_TABLE_MAGIC, 4);
+    put_u32(buf + 4, table->count);
+    for (uint i = 0; i < table->count; i++)
+    {
+        put_u32(buf + 8 + 8 * i, table->slot[i].start);
+        put_u32(buf + 12 + 8 * i, table->slot[i].length);
+    }
+}
+
+/*
+ * Function: read_payload_length
+ * -----------------------------
+ * Decodes the payload header at the current position (magic string,
+ * extension size, extension, secret size) and returns the length of the
+ * whole payload. Used to describe a legacy image as slot 0.
+ */
+Status read_payload_length(PixelSource *src, uint *length)
+{
+    char buf[SLOT_MAX_EXTN + 4];
+    uint extn_size, size;
+
+    if (decode_data_from_lsb(src, buf, 6) != e_success || memcmp(buf, MAGIC_STRING, 2) != 0)
+        return e_failure;
+    extn_size = get_u32(buf + 2);
+    if (extn_size > SLOT_MAX_EXTN || decode_data_from_lsb(src, buf, extn_size + 4) != e_success)
+        return e_failure;
+    size = get_u32(buf + extn_size);
+    if (size > 0x7FFFFFFF)
+        return e_failure;
+
+    *length = 2 + 4 + extn_size + 4 + size;
+    return e_success;
+}
+
+/*
+ * Function: get_slots_end
+ * -----------------------
+ * Returns the first payload byte after the last slot: where the next
+ * appended payload goes.
+ */
+uint get_slots_end(const SlotTable *table)
+{
+    const SlotEntry *last = &table->slot[table->count - 1];
+    return last->start + last->length;
+}
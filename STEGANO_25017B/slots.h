@@ -0,0 +1,56 @@
+#ifndef SLOTS_H
+#define SLOTS_H
+
+#include <stdio.h>
+#include "types.h"        // Contains user defined types
+#include "pixel_source.h" // Cover stream backends
+
+/* Most payloads one image can carry */
+#define MAX_SLOTS 16
+
+/* Bytes of the slot table: magic, 32-bit count, then (start, length) pairs */
+#define SLOT_TABLE_SIZE (4 + 4 + MAX_SLOTS * 8)
+
+/*
+ * One payload in the image. Offsets and lengths are in payload bytes:
+ * payload byte k is carried by pixel bytes 8k to 8k + 7.
+ */
+typedef struct _SlotEntry
+{
+    uint start;     // First payload byte of the slot (its magic string)
+    uint length;    // Payload bytes of the slot: header and data
+} SlotEntry;
+
+/*
+ * Slot table, kept in the last SLOT_TABLE_SIZE payload bytes of the cover.
+ * Slot 0 is the payload at the start of the image (the legacy layout), so an
+ * image without a table simply has one slot.
+ */
+typedef struct _SlotTable
+{
+    uint count;                  // Slots in use
+    SlotEntry slot[MAX_SLOTS];   // Slots in order of their start
+} SlotTable;
+
+/* Slot function prototypes */
+
+/* Move a pixel source to a payload byte, from its state at the first pixel byte */
+Status seek_payload_offset(PixelSource *src, const PixelSource *start, long start_pos, unsigned long long offset);
+
+/* Payload byte where the slot table of a cover with the given pixel capacity starts */
+Status get_slot_table_offset(unsigned long long capacity, unsigned long long *offset);
+
+/* Read the slot table, e_failure when the image has none */
+Status read_slot_table(PixelSource *src, const PixelSource *start, long start_pos,
+                       unsigned long long capacity, SlotTable *table);
+
+/* Lay out a slot table as the bytes to embed */
+void build_slot_table(char *buf, const SlotTable *table);
+
+/* Length of the legacy payload (header and data) at the current position */
+Status read_payload_length(PixelSource *src, uint *length);
+
+/* First payload byte after all slots */
+uint get_slots_end(const SlotTable *table);
+
+#endif
@@ -16,7 +16,24 @@ typedef enum
 {
     e_encode,       // Represents encoding operation
     e_decode,       // Represents decoding operation
+    e_update,       // Represents in-place update of an existing stego image
+    e_analyze,      // Represents quality/detectability analysis of stego images
     e_unsupported   // Represents unsupported operation type
 } OperationType;
 
+/* Options given as --flags anywhere after the operation */
+typedef struct _Options
+{
+    char *cache_dir;                 // --cache DIR: reuse results of identical encode jobs
+    unsigned long long cache_max;    // --cache-max MB: size bound of the cache directory
+    int fanout;                      // --fanout: embed one secret into every cover that follows
+    int jobs;                        // --jobs N: worker threads (default: one per CPU)
+    int resume;                      // --resume: continue an interrupted job from its checkpoint
+    unsigned long long checkpoint;   // --checkpoint MB: pixel bytes between checkpoints (0 = off)
+    int stats;                       // --stats: report heap allocations made by the job
+    int progress;                    // --progress: JSON progress events on stderr
+    int append;                      // --append: add the secret as a new slot of an existing stego image
+    int slot;                        // --slot N: decode only slot N (-1 = the payload at the start)
+} Options;
+
 #endif  // End of header guard
@@ -0,0 +1,426 @@
+#include <stdio.h>
+#include <string.h>
+#include "update.h"
+#include "encode.h"
+#include "types.h"
+#include "common.h"
+#include "slots.h"
+
+/* ---------- In-place update of the secret inside a stego image ---------- */
+
+/* Pixel bytes are compared one page of the file at a time */
+#define UPDATE_PAGE 4096
+
+/* Secret bytes read per block */
+#define UPDATE_DATA_BLOCK 4096
+
+/*
+ * Function: read_and_validate_update_args
+ * ---------------------------------------
+ * Validates the command-line arguments for an in-place update:
+ * the existing stego image and the new secret file.
+ */
+Status read_and_validate_update_args(char *argv[], UpdateInfo *updInfo)
+{
+    // Validate stego image file
+    if (argv[2] == NULL || pixel_source_ops_for(argv[2]) == NULL)
+    {
+        fprintf(stderr, "ERROR: Invalid stego image. Must end with '.bmp', '.y4m' or '.ppm'\n");
+        return e_failure;
+    }
+    updInfo->stego_image_fname = argv[2];
+
+    // Validate new secret file
+    if (argv[3] == NULL || argv[3][0] == '.' || get_secret_file_extn(argv[3]) == NULL)
+    {
+        fprintf(stderr, "ERROR: Invalid secret file. Must end with '.txt', '.c', '.h', or '.sh'\n");
+        return e_failure;
+    }
+    updInfo->secret_fname = argv[3];
+
+    return e_success;
+}
+
+/*
+ * Function: open_files_u
+ * ----------------------
+ * Opens the stego image read-write (nothing is truncated) and the new secret.
+ */
+Status open_files_u(UpdateInfo *updInfo)
+{
+    updInfo->fptr_stego_image = fopen(updInfo->stego_image_fname, "r+");
+    if (updInfo->fptr_stego_image == NULL)
+    {
+        perror("fopen");
+        fprintf(stderr, "ERROR: Unable to open file %s\n", updInfo->stego_image_fname);
+        return e_failure;
+    }
+
+    updInfo->fptr_secret = fopen(updInfo->secret_fname, "r");
+    if (updInfo->fptr_secret == NULL)
+    {
+        perror("fopen");
+        fprintf(stderr, "ERROR: Unable to open file %s\n", updInfo->secret_fname);
+        return e_failure;
+    }
+
+    // Pixels are written back through the same stream, so no separate output
+    return pixel_source_open(&updInfo->src, updInfo->stego_image_fname, updInfo->fptr_stego_image, NULL);
+}
+
+/*
+ * Function: check_update_capacity
+ * -------------------------------
+ * Checks that the stego image can hold the new header and secret.
+ */
+Status check_update_capacity(UpdateInfo *updInfo)
+{
+    unsigned long long total_bytes;
+
+    updInfo->size_secret_file = get_file_size(updInfo->fptr_secret);
+    if (updInfo->size_secret_file < 0)
+    {
+        fprintf(stderr, "ERROR: Unable to get the size of %s\n", updInfo->secret_fname);
+        return e_failure;
+    }
+    if (updInfo->size_secret_file > 0x7FFFFFFF)
+    {
+        fprintf(stderr, "ERROR: Secret file is larger than 2 GB\n");
+        return e_failure;
+    }
+    if (store_secret_file_extn(updInfo->extn_secret_file, sizeof(updInfo->extn_secret_file), updInfo->secret_fname) != e_success)
+        return e_failure;
+
+    if (pixel_source_capacity(&updInfo->src, &updInfo->image_capacity) != e_success)
+    {
+        fprintf(stderr, "ERROR: %s must be a regular file to be updated in place\n", updInfo->stego_image_fname);
+        return e_failure;
+    }
+
+    total_bytes = (strlen(MAGIC_STRING) + 4 + strlen(updInfo->extn_secret_file) + 4 + updInfo->size_secret_file) * 8ULL;
+    if (updInfo->image_capacity < total_bytes)
+    {
+        fprintf(stderr, "ERROR: Stego image holds %llu bytes, %llu needed\n", updInfo->image_capacity, total_bytes);
+        return e_failure;
+    }
+    return e_success;
+}
+
+/*
+ * Function: update_data_to_lsb
+ * ----------------------------
+ * Embeds a block of bytes into the next size * 8 pixel bytes of the stego
+ * image. Pixels are read one file page at a time; only the range between
+ * the first and last pixel whose LSB actually changes is written back, and
+ * pages where nothing changes are not written at all.
+ */
+Status update_data_to_lsb(UpdateInfo *updInfo, const char *data, size_t size)
+{
+    char page[UPDATE_PAGE];
+    size_t nbits = size * 8, done, got, want, bit;
+    long pos;
+    int first, last;
+    char pixel;
+
+    for (done = 0; done < nbits; done += got)
+    {
+        // Stay inside the current frame and the current file page
+        if (pixel_source_span(&updInfo->src) == 0 || (pos = ftell(updInfo->fptr_stego_image)) < 0)
+        {
+            fprintf(stderr, "ERROR: Stego %s ended before the secret was embedded\n", updInfo->src.ops->name);
+            return e_failure;
+        }
+        want = UPDATE_PAGE - (pos % UPDATE_PAGE);
+        if (want > nbits - done)
+            want = nbits - done;
+
+        got = pixel_source_read_span(&updInfo->src, page, want);
+        if (got == 0)
+            return e_failure;
+
+        first = last = -1;
+        for (size_t i = 0; i < got; i++)
+        {
+            bit = done + i;
+            pixel = (page[i] & ~1) | ((data[bit >> 3] >> (bit & 7)) & 1);
+            if (pixel != page[i])
+            {
+                page[i] = pixel;
+                if (first < 0)
+                    first = i;
+                last = i;
+            }
+        }
+        updInfo->bytes_scanned += got;
+
+        if (first >= 0)
+        {
+            // Write back the changed range, then return to where reading stopped
+            if (fseek(updInfo->fptr_stego_image, pos + first, SEEK_SET) != 0 ||
+                fwrite(page + first, 1, last - first + 1, updInfo->fptr_stego_image) != (size_t)(last - first + 1) ||
+                fseek(updInfo->fptr_stego_image, pos + got, SEEK_SET) != 0)
+            {
+                perror("fwrite");
+                return e_failure;
+            }
+            updInfo->bytes_written += last - first + 1;
+            updInfo->pages_written++;
+        }
+    }
+    return e_success;
+}
+
+/*
+ * Function: update_secret_file_data
+ * ---------------------------------
+ * Embeds the new header (magic string, extension, size) followed by the
+ * new secret. What is left of a longer old secret past the new end is
+ * scrubbed afterwards by scrub_old_payload.
+ */
+Status update_secret_file_data(UpdateInfo *updInfo)
+{
+    char header[MAX_PAYLOAD_HEADER];
+    char data[UPDATE_DATA_BLOCK];
+    uint header_len = build_payload_header(header, updInfo->extn_secret_file, updInfo->size_secret_file);
+    long remaining;
+    size_t chunk;
+
+    if (update_data_to_lsb(updInfo, header, header_len) != e_success)
+        return e_failure;
+
+    rewind(updInfo->fptr_secret);
+    for (remaining = updInfo->size_secret_file; remaining > 0; remaining -= chunk)
+    {
+        chunk = remaining < (long)sizeof(data) ? (size_t)remaining : sizeof(data);
+        if (fread(data, 1, chunk, updInfo->fptr_secret) != chunk)
+        {
+            fprintf(stderr, "ERROR: Secret file %s changed while updating\n", updInfo->secret_fname);
+            return e_failure;
+        }
+        if (update_data_to_lsb(updInfo, data, chunk) != e_success)
+            return e_failure;
+    }
+    return e_success;
+}
+
+/*
+ * Function: read_old_payload_length
+ * ---------------------------------
+ * Parses the header of the payload being replaced, at the first pixel
+ * byte, so that its tail can be scrubbed. An image without a readable
+ * header has nothing to scrub. Leaves the image at its first pixel byte.
+ */
+Status read_old_payload_length(UpdateInfo *updInfo)
+{
+    uint length;
+
+    if (read_payload_length(&updInfo->src, &length) == e_success)
+        updInfo->old_length = length;
+    else
+        updInfo->old_length = 0;
+
+    // Never scrub past the capacity, whatever the old header claims
+    if (updInfo->old_length > updInfo->image_capacity / 8)
+        updInfo->old_length = updInfo->image_capacity / 8;
+    return seek_payload_offset(&updInfo->src, &updInfo->start, updInfo->start_pos, 0);
+}
+
+/*
+ * Function: scrub_old_payload
+ * ---------------------------
+ * Called right after the new payload is embedded. If the old payload was
+ * longer, its remaining bytes are overwritten with bits from /dev/urandom,
+ * so a rotated secret cannot be recovered from the LSBs past the new end.
+ * Only the old tail is touched, not the rest of the image.
+ */
+Status scrub_old_payload(UpdateInfo *updInfo)
+{
+    char data[UPDATE_DATA_BLOCK];
+    unsigned long long length = strlen(MAGIC_STRING) + 4 + strlen(updInfo->extn_secret_file) + 4 + updInfo->size_secret_file;
+    unsigned long long remaining;
+    size_t chunk;
+    FILE *fptr_random;
+
+    if (updInfo->old_length <= length)
+        return e_success;
+
+    fptr_random = fopen("/dev/urandom", "r");
+    if (fptr_random == NULL)
+    {
+        perror("/dev/urandom");
+        return e_failure;
+    }
+
+    for (remaining = updInfo->old_length - length; remaining > 0; remaining -= chunk)
+    {
+        chunk = remaining < sizeof(data) ? (size_t)remaining : sizeof(data);
+        if (fread(data, 1, chunk, fptr_random) != chunk || update_data_to_lsb(updInfo, data, chunk) != e_success)
+        {
+            fprintf(stderr, "ERROR: Unable to scrub the old secret\n");
+            fclose(fptr_random);
+            return e_failure;
+        }
+    }
+    fclose(fptr_random);
+    return e_success;
+}
+
+/*
+ * Function: check_update_slots
+ * ----------------------------
+ * On an image with a slot table the new secret replaces slot 0 only, so
+ * it has to end before slot 1 (or the table). The table entry of slot 0
+ * is updated to the new length; its old length bounds the scrub. Leaves
+ * the image at its first pixel byte.
+ */
+Status check_update_slots(UpdateInfo *updInfo)
+{
+    unsigned long long table_offset, limit;
+    unsigned long long length = strlen(MAGIC_STRING) + 4 + strlen(updInfo->extn_secret_file) + 4 + updInfo->size_secret_file;
+
+    updInfo->has_slot_table = read_slot_table(&updInfo->src, &updInfo->start, updInfo->start_pos,
+                                              updInfo->image_capacity, &updInfo->slots) == e_success;
+    if (updInfo->has_slot_table)
+    {
+        get_slot_table_offset(updInfo->image_capacity, &table_offset);
+        limit = updInfo->slots.count > 1 ? updInfo->slots.slot[1].start : table_offset;
+        if (length > limit)
+        {
+            fprintf(stderr, "ERROR: New secret needs %llu payload bytes, slot 0 has room for %llu before %s\n",
+                    length, limit, updInfo->slots.count > 1 ? "slot 1" : "the slot table");
+            return e_failure;
+        }
+        updInfo->old_length = updInfo->slots.slot[0].length;
+        updInfo->slots.slot[0].length = length;
+    }
+    return seek_payload_offset(&updInfo->src, &updInfo->start, updInfo->start_pos, 0);
+}
+
+/*
+ * Function: write_slot_table
+ * --------------------------
+ * Embeds the slot table at the end of the capacity through the page
+ * writer, so only pixel bytes whose LSB changes are written.
+ */
+Status write_slot_table(UpdateInfo *updInfo)
+{
+    char buf[SLOT_TABLE_SIZE];
+    unsigned long long table_offset;
+
+    if (!updInfo->has_slot_table)
+        return e_success;
+
+    build_slot_table(buf, &updInfo->slots);
+    if (get_slot_table_offset(updInfo->image_capacity, &table_offset) != e_success ||
+        seek_payload_offset(&updInfo->src, &updInfo->start, updInfo->start_pos, table_offset) != e_success)
+        return e_failure;
+    return update_data_to_lsb(updInfo, buf, sizeof(buf));
+}
+
+/*
+ * Function: do_update
+ * -------------------
+ * Master function for the in-place update: opens the stego image
+ * read-write, checks capacity and rewrites only the changed pixel bytes.
+ */
+Status do_update(UpdateInfo *updInfo)
+{
+    updInfo->bytes_scanned = updInfo->bytes_written = 0;
+    updInfo->pages_written = 0;
+
+    if (open_files_u(updInfo) == e_success)
+    {
+        if (pixel_source_begin(&updInfo->src) == e_success && (updInfo->start_pos = ftell(updInfo->fptr_stego_image)) >= 0)
+        {
+            updInfo->start = updInfo->src; // slots are located from the first pixel byte
+            if (check_update_capacity(updInfo) == e_success && read_old_payload_length(updInfo) == e_success &&
+                check_update_slots(updInfo) == e_success)
+            {
+                if (update_secret_file_data(updInfo) == e_success && scrub_old_payload(updInfo) == e_success &&
+                    write_slot_table(updInfo) == e_success)
+                {
+                    if (fflush(updInfo->fptr_stego_image) == 0)
+                    {
+                        printf("Rewrote %llu of %llu pixel bytes in %lu pages\n",
+                               updInfo->bytes_written, updInfo->bytes_scanned, updInfo->pages_written);
+                        return e_success;
+                    }
+                }
+            }
+        }
+    }
+    return e_failure;
+}
+
+/*
+ * Function: do_append
+ * -------------------
+ * Master function for "-e --append": embeds the secret in the next free
+ * region of an existing stego image and records it in the slot table.
+ * Only those pixel bytes and the table are touched; a legacy image first
+ * gets a table with its payload as slot 0.
+ */
+Status do_append(UpdateInfo *updInfo)
+{
+    unsigned long long table_offset, start, length;
+    uint legacy_length;
+
+    updInfo->bytes_scanned = updInfo->bytes_written = 0;
+    updInfo->pages_written = 0;
+
+    if (open_files_u(updInfo) == e_success)
+    {
+        if (pixel_source_begin(&updInfo->src) == e_success && (updInfo->start_pos = ftell(updInfo->fptr_stego_image)) >= 0)
+        {
+            updInfo->start = updInfo->src; // slots are located from the first pixel byte
+            if (check_update_capacity(updInfo) == e_success && get_slot_table_offset(updInfo->image_capacity, &table_offset) == e_success)
+            {
+                // No table yet: the payload at the start of the image becomes slot 0
+                if (read_slot_table(&updInfo->src, &updInfo->start, updInfo->start_pos, updInfo->image_capacity, &updInfo->slots) != e_success)
+                {
+                    if (seek_payload_offset(&updInfo->src, &updInfo->start, updInfo->start_pos, 0) != e_success ||
+                        read_payload_length(&updInfo->src, &legacy_length) != e_success || legacy_length > table_offset)
+                    {
+                        fprintf(stderr, "ERROR: %s has no payload to append to\n", updInfo->stego_image_fname);
+                        return e_failure;
+                    }
+                    updInfo->slots.count = 1;
+                    updInfo->slots.slot[0].start = 0;
+                    updInfo->slots.slot[0].length = legacy_length;
+                }
+                updInfo->has_slot_table = 1;
+
+                start = get_slots_end(&updInfo->slots);
+                length = strlen(MAGIC_STRING) + 4 + strlen(updInfo->extn_secret_file) + 4 + updInfo->size_secret_file;
+                if (updInfo->slots.count >= MAX_SLOTS)
+                {
+                    fprintf(stderr, "ERROR: %s already holds %d slots\n", updInfo->stego_image_fname, MAX_SLOTS);
+                    return e_failure;
+                }
+                if (start + length > table_offset || start + length > 0xFFFFFFFFULL)
+                {
+                    fprintf(stderr, "ERROR: %llu payload bytes free, %llu needed\n",
+                            start < table_offset ? table_offset - start : 0, length);
+                    return e_failure;
+                }
+
+                if (seek_payload_offset(&updInfo->src, &updInfo->start, updInfo->start_pos, start) == e_success &&
+                    update_secret_file_data(updInfo) == e_success)
+                {
+                    updInfo->slots.slot[updInfo->slots.count].start = start;
+                    updInfo->slots.slot[updInfo->slots.count].length = length;
+                    updInfo->slots.count++;
+
+                    if (write_slot_table(updInfo) == e_success && fflush(updInfo->fptr_stego_image) == 0)
+                    {
+                        printf("Appended slot %u at payload byte %llu (%llu bytes)\n", updInfo->slots.count - 1, start, length);
+                        printf("Rewrote %llu of %llu pixel bytes in %lu pages\n",
+                               updInfo->bytes_written, updInfo->bytes_scanned, updInfo->pages_written);
+                        return e_success;
+                    }
+                }
+            }
+        }
+    }
+    return e_failure;
+}
@@ -0,0 +1,75 @@
+#ifndef UPDATE_H
+#define UPDATE_H
+
+#include <stdio.h>
+#include "types.h"        // Contains user defined types
+#include "pixel_source.h" // Cover stream backends
+#include "slots.h"        // Slot table of appendable payloads
+
+/*
+ * Structure to store information required for
+ * replacing the secret inside an existing stego image in place
+ */
+typedef struct _UpdateInfo
+{
+    /* Stego Image Info (opened read-write) */
+    char *stego_image_fname;           // To store the stego image name
+    FILE *fptr_stego_image;            // To store the address of the stego image
+    PixelSource src;                   // To walk the stego pixels frame by frame
+    unsigned long long image_capacity; // To store the pixel bytes available
+
+    /* New Secret File Info */
+    char *secret_fname;                // To store the new secret file name
+    FILE *fptr_secret;                 // To store the new secret file address
+    char extn_secret_file[5];          // To store the new secret file extension
+    long size_secret_file;             // To store the size of the new secret
+    unsigned long long old_length;     // Payload bytes (header and data) of the secret being replaced
+
+    /* Update statistics */
+    unsigned long long bytes_scanned;  // Pixel bytes compared
+    unsigned long long bytes_written;  // Pixel bytes rewritten
+    unsigned long pages_written;       // Pages that had at least one changed LSB
+
+    /* Slot table */
+    PixelSource start;                 // Pixel source state at the first pixel byte
+    long start_pos;                    // File offset of the first pixel byte
+    SlotTable slots;                   // Slots of the image
+    int has_slot_table;                // The image carries a slot table
+} UpdateInfo;
+
+/* Update function prototypes */
+
+/* Read and validate Update args from argv */
+Status read_and_validate_update_args(char *argv[], UpdateInfo *updInfo);
+
+/* Perform the in-place update */
+Status do_update(UpdateInfo *updInfo);
+
+/* Open the stego image read-write and the new secret read-only */
+Status open_files_u(UpdateInfo *updInfo);
+
+/* Check the stego image can hold the new secret */
+Status check_update_capacity(UpdateInfo *updInfo);
+
+/* Embed a block of bytes, writing back only the pixel bytes whose LSB changes */
+Status update_data_to_lsb(UpdateInfo *updInfo, const char *data, size_t size);
+
+/* Embed the new header and secret file data in place */
+Status update_secret_file_data(UpdateInfo *updInfo);
+
+/* Check a new slot 0 fits in front of slot 1 and the slot table */
+Status check_update_slots(UpdateInfo *updInfo);
+
+/* Read the length of the payload being replaced from its header */
+Status read_old_payload_length(UpdateInfo *updInfo);
+
+/* Overwrite the rest of a longer old payload with random bits */
+Status scrub_old_payload(UpdateInfo *updInfo);
+
+/* Write the slot table back (only where its LSBs change) */
+Status write_slot_table(UpdateInfo *updInfo);
+
+/* Append the secret as a new slot after the existing ones */
+Status do_append(UpdateInfo *updInfo);
+
+#endif